@@ -0,0 +1,347 @@
+#!/usr/bin/env python3
+# Generatore di carico e benchmark end-to-end: pilota il gateway con N client
+# concorrenti e un mix configurabile di comandi (deploy, start, start+wait,
+# stop, status) e riporta throughput e latenze p50/p99/p999.
+# Con --profiles confronta invece i profili di build del gateway (speed, size,
+# trusted-fast): dimensione del codice e cicli misurati sul device per ogni profilo.
+# Si usa contro fake_agent.py (ripetibile) o contro il bridge Renode / la board.
+import argparse
+import json
+import math
+import os
+import random
+import tempfile
+import threading
+import time
+
+from host import send_request
+
+
+# Operazioni supportate nel mix
+OPS = ("deploy", "start", "start_wait", "stop", "status")
+
+
+def parse_mix(text: str) -> dict:
+    # "status=4,start_wait=4,deploy=1" -> {"status": 4, ...}
+    mix = {}
+    for item in text.split(","):
+        item = item.strip()
+        if not item:
+            continue
+        name, _, weight = item.partition("=")
+        if name not in OPS:
+            raise SystemExit(f"operazione sconosciuta nel mix: {name} (valide: {', '.join(OPS)})")
+        mix[name] = float(weight) if weight else 1.0
+    if not mix:
+        raise SystemExit("mix vuoto")
+    return mix
+
+
+def make_synthetic_module(size: int, tmpdir: str) -> str:
+    # payload con header Wasm valido e padding: accettato da fake_agent.py, non da WAMR
+    path = os.path.join(tmpdir, f"synthetic_{size}.wasm")
+    header = b"\x00asm\x01\x00\x00\x00"
+    body = random.Random(size).randbytes(max(size - len(header), 0))
+    with open(path, "wb") as f:
+        f.write((header + body)[:size])
+    return path
+
+
+def percentile(sorted_values, p: float) -> float:
+    # nearest-rank
+    if not sorted_values:
+        return 0.0
+    k = math.ceil(p / 100.0 * len(sorted_values)) - 1
+    return sorted_values[max(0, min(len(sorted_values) - 1, k))]
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.samples = {}    # op -> lista di (latency_ms, ok)
+        self.stages = {}     # op -> stadio -> lista di ms (da timings_ms del gateway)
+
+    def add(self, op: str, latency_ms: float, resp):
+        ok = bool(resp and resp.get("ok"))
+        with self.lock:
+            self.samples.setdefault(op, []).append((latency_ms, ok))
+            if resp and isinstance(resp.get("timings_ms"), dict):
+                per_op = self.stages.setdefault(op, {})
+                for stage, ms in resp["timings_ms"].items():
+                    per_op.setdefault(stage, []).append(ms)
+
+
+def summarize(samples, wall_s: float) -> dict:
+    lat = sorted(ms for ms, _ in samples)
+    ok = sum(1 for _, good in samples if good)
+    return {
+        "count": len(samples),
+        "ok": ok,
+        "errors": len(samples) - ok,
+        "throughput_rps": round(len(samples) / wall_s, 2) if wall_s > 0 else 0.0,
+        "p50_ms": round(percentile(lat, 50), 3),
+        "p99_ms": round(percentile(lat, 99), 3),
+        "p999_ms": round(percentile(lat, 99.9), 3),
+        "max_ms": round(lat[-1], 3) if lat else 0.0,
+    }
+
+
+def build_payload(op: str, args, rng: random.Random, deploy_files):
+    if op == "deploy":
+        return {
+            "cmd": "deploy",
+            "device": args.device,
+            "module_id": args.module_id,
+            "wasm_path": rng.choice(deploy_files),
+        }, args.client_timeout
+    if op in ("start", "start_wait"):
+        wait = op == "start_wait"
+        return {
+            "cmd": "start",
+            "device": args.device,
+            "module_id": args.module_id,
+            "func_name": args.func,
+            "func_args": args.func_args,
+            "wait_result": wait,
+            "result_timeout": args.result_timeout,
+        }, args.client_timeout + (args.result_timeout if wait else 0.0)
+    if op == "stop":
+        return {
+            "cmd": "stop",
+            "device": args.device,
+            "module_id": args.module_id,
+            "result_timeout": args.result_timeout,
+        }, args.client_timeout + args.result_timeout
+    return {"cmd": "status", "device": args.device}, args.client_timeout
+
+
+def worker(idx: int, args, mix, deploy_files, stats: Stats, budget, deadline):
+    rng = random.Random(args.seed + idx)
+    ops = list(mix)
+    weights = [mix[o] for o in ops]
+    while True:
+        if deadline is not None and time.perf_counter() >= deadline:
+            return
+        if budget is not None:
+            with budget["lock"]:
+                if budget["left"] <= 0:
+                    return
+                budget["left"] -= 1
+
+        op = rng.choices(ops, weights)[0]
+        payload, timeout = build_payload(op, args, rng, deploy_files)
+        t0 = time.perf_counter()
+        try:
+            resp = send_request(args.gw_host, args.gw_port, payload, timeout=timeout)
+        except OSError:
+            resp = None
+        stats.add(op, (time.perf_counter() - t0) * 1000.0, resp)
+
+
+def run_phase(args, mix, deploy_files, requests, duration):
+    stats = Stats()
+    budget = {"left": requests, "lock": threading.Lock()} if requests else None
+    t0 = time.perf_counter()
+    deadline = t0 + duration if duration else None
+    threads = [
+        threading.Thread(target=worker,
+                         args=(i, args, mix, deploy_files, stats, budget, deadline),
+                         daemon=True)
+        for i in range(args.concurrency)
+    ]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    return stats, time.perf_counter() - t0
+
+
+def print_report(report: dict):
+    cols = ("count", "ok", "errors", "throughput_rps", "p50_ms", "p99_ms", "p999_ms", "max_ms")
+    print(f"{'op':<12}" + "".join(f"{c:>15}" for c in cols))
+    for op, row in report["ops"].items():
+        print(f"{op:<12}" + "".join(f"{row[c]:>15}" for c in cols))
+    print(f"{'TOTAL':<12}" + "".join(f"{report['total'][c]:>15}" for c in cols))
+    if report["stages_p50_ms"]:
+        print("\np50 per stadio (ms, da timings_ms del gateway):")
+        for op, stages in report["stages_p50_ms"].items():
+            items = ", ".join(f"{k}={v}" for k, v in stages.items())
+            print(f"  {op}: {items}")
+
+
+# Confronto dei profili di build: build_and_deploy con ciascun profilo, poi chiamate
+# sequenziali con attesa del RESULT (cycles/exec_us misurano la sola chiamata Wasm sul device)
+
+def result_field(detail: str, key: str):
+    for tok in str(detail).split():
+        name, sep, val = tok.partition("=")
+        if sep and name == key and val.isdigit():
+            return int(val)
+    return None
+
+
+def run_profiles(args) -> dict:
+    rows = []
+    for profile in [p.strip() for p in args.profiles.split(",") if p.strip()]:
+        build = {
+            "cmd": "build_and_deploy",
+            "device": args.device,
+            "module_id": args.module_id,
+            "source_path": os.path.abspath(args.source),
+            "mode": args.build_mode,
+            "profile": profile,
+        }
+        resp = send_request(args.gw_host, args.gw_port, build, timeout=120.0)
+        if not resp or not resp.get("ok"):
+            rows.append({"profile": profile, "error": (resp or {}).get("error", "nessuna risposta")})
+            continue
+
+        start = {
+            "cmd": "start",
+            "device": resp.get("device", args.device),   # con device=auto, dove è finito il deploy
+            "module_id": args.module_id,
+            "func_name": args.func,
+            "func_args": args.func_args,
+            "wait_result": True,
+            "result_timeout": args.result_timeout,
+        }
+        cycles, exec_us, errors = [], [], 0
+        for i in range(args.warmup + args.requests):
+            try:
+                res = send_request(args.gw_host, args.gw_port, start,
+                                   timeout=args.client_timeout + args.result_timeout)
+            except OSError:
+                res = None
+            if i < args.warmup:
+                continue
+            c = result_field(res.get("detail"), "cycles") if res and res.get("ok") else None
+            if c is None:
+                errors += 1
+                continue
+            cycles.append(c)
+            exec_us.append(result_field(res["detail"], "exec_us") or 0)
+        cycles.sort()
+        exec_us.sort()
+        rows.append({
+            "profile": profile,
+            "wasm_bytes": resp.get("wasm_size"),
+            "aot_bytes": resp.get("aot_size"),
+            "calls": len(cycles),
+            "errors": errors,
+            "cycles_p50": percentile(cycles, 50),
+            "cycles_min": cycles[0] if cycles else 0,
+            "exec_us_p50": percentile(exec_us, 50),
+        })
+    return {"device": args.device, "module_id": args.module_id, "func": args.func,
+            "build_mode": args.build_mode, "profiles": rows}
+
+
+def print_profiles(report: dict):
+    cols = ("wasm_bytes", "aot_bytes", "calls", "errors", "cycles_p50", "cycles_min", "exec_us_p50")
+    print(f"{'profile':<14}" + "".join(f"{c:>13}" for c in cols))
+    for row in report["profiles"]:
+        if "error" in row:
+            print(f"{row['profile']:<14}  errore: {row['error']}")
+            continue
+        print(f"{row['profile']:<14}" + "".join(f"{str(row[c]):>13}" for c in cols))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Benchmark end-to-end del gateway (throughput, p50/p99/p999)"
+    )
+    parser.add_argument("--gw-host", default="localhost", help="Hostname o IP del gateway")
+    parser.add_argument("--gw-port", type=int, default=9000, help="Porta TCP del gateway")
+    parser.add_argument("--device", required=True,
+                        help="ID logico del device (es. fake, disco, nucleo, auto)")
+    parser.add_argument("--concurrency", type=int, default=4, help="Client concorrenti")
+    parser.add_argument("--requests", type=int, default=200,
+                        help="Numero totale di richieste (ignorato se --duration > 0)")
+    parser.add_argument("--duration", type=float, default=0.0,
+                        help="Durata del benchmark in secondi (0 = usa --requests)")
+    parser.add_argument("--warmup", type=int, default=10,
+                        help="Richieste di riscaldamento, escluse dai risultati")
+    parser.add_argument("--mix", default="status=4,start_wait=4,start=1,stop=1",
+                        help=f"Pesi delle operazioni ({', '.join(OPS)})")
+    parser.add_argument("--module-id", default="math_ops")
+    parser.add_argument("--func", default="add", help="Funzione per start/start_wait")
+    parser.add_argument("--func-args", default="a=1,b=2")
+    parser.add_argument("--result-timeout", type=float, default=10.0)
+    parser.add_argument("--client-timeout", type=float, default=30.0,
+                        help="Timeout lato client di ogni richiesta, inclusa l'attesa in coda "
+                             "sul gateway (a cui si somma --result-timeout per start_wait/stop)")
+    parser.add_argument("--deploy-file", action="append", default=[],
+                        help="File .wasm/.aot da usare per deploy (ripetibile)")
+    parser.add_argument("--deploy-sizes", default="1024,8192",
+                        help="Dimensioni (byte) di moduli sintetici se non c'è --deploy-file "
+                             "(solo per fake_agent.py)")
+    parser.add_argument("--no-setup", action="store_true",
+                        help="Non fare il deploy iniziale del modulo")
+    parser.add_argument("--profiles", default="",
+                        help="Confronta i profili di build indicati (es. speed,size,trusted-fast): "
+                             "build_and_deploy di --source con ciascuno, poi --requests chiamate "
+                             "sequenziali di --func")
+    parser.add_argument("--source", help="Sorgente C per --profiles")
+    parser.add_argument("--build-mode", choices=["aot", "wasm"], default="aot",
+                        help="Binario deployato con --profiles (default: aot)")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--json", action="store_true", help="Stampa il report in JSON")
+    args = parser.parse_args()
+
+    if args.profiles:
+        if not args.source:
+            raise SystemExit("--profiles richiede --source")
+        report = run_profiles(args)
+        if args.json:
+            print(json.dumps(report, indent=2))
+        else:
+            print_profiles(report)
+        return
+
+    mix = parse_mix(args.mix)
+
+    with tempfile.TemporaryDirectory() as tmpdir:
+        deploy_files = [os.path.abspath(p) for p in args.deploy_file]
+        if not deploy_files:
+            deploy_files = [make_synthetic_module(int(s), tmpdir)
+                            for s in args.deploy_sizes.split(",") if s.strip()]
+
+        if not args.no_setup:
+            setup = {
+                "cmd": "deploy",
+                "device": args.device,
+                "module_id": args.module_id,
+                "wasm_path": deploy_files[0],
+            }
+            resp = send_request(args.gw_host, args.gw_port, setup, timeout=30.0)
+            if not resp or not resp.get("ok"):
+                raise SystemExit(f"deploy iniziale fallito: {resp}")
+
+        if args.warmup:
+            run_phase(args, mix, deploy_files, args.warmup, 0.0)
+
+        stats, wall_s = run_phase(args, mix, deploy_files,
+                                  0 if args.duration else args.requests,
+                                  args.duration)
+
+    all_samples = [s for samples in stats.samples.values() for s in samples]
+    report = {
+        "device": args.device,
+        "concurrency": args.concurrency,
+        "wall_s": round(wall_s, 3),
+        "ops": {op: summarize(stats.samples[op], wall_s) for op in sorted(stats.samples)},
+        "total": summarize(all_samples, wall_s),
+        "stages_p50_ms": {
+            op: {stage: round(percentile(sorted(v), 50), 3) for stage, v in stages.items()}
+            for op, stages in sorted(stats.stages.items())
+        },
+    }
+
+    if args.json:
+        print(json.dumps(report, indent=2))
+    else:
+        print_report(report)
+
+
+if __name__ == "__main__":
+    main()
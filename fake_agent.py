@@ -0,0 +1,742 @@
+#!/usr/bin/env python3
+# Agent simulato in software: parla lo stesso protocollo testuale del firmware
+# (LOAD/START/STOP/STATUS/SCHEDULE/FETCH/SIGS) su una socket TCP, come il bridge Renode su USART2.
+# Non esegue Wasm: le funzioni esportate sono simulate in Python, con tempi
+# configurabili, così i benchmark sono ripetibili su una normale macchina Linux.
+import argparse
+import binascii
+import collections
+import socket
+import threading
+import time
+
+from gateway import parse_wasm_value
+
+
+# Magic number accettati nel payload di LOAD (modulo Wasm o AOT di WAMR)
+WASM_MAGIC = b"\x00asm"
+AOT_MAGIC = b"\x00aot"
+
+LINE_BUF_SIZE = 256   # come LINE_BUF_SIZE nel firmware: righe più lunghe vengono troncate
+MAX_SCHEDULES = 4     # come AGENT_MAX_SCHEDULES
+SCHED_RESULTS = 16    # ring dei risultati schedulati
+PRIO_CLASSES = ("high", "normal", "low")   # un runner per classe, come AGENT_PRIO_CLASSES
+PRIO_NORMAL = 1
+JOB_QUEUE_LEN = 4     # job in attesa per classe, oltre a quello in esecuzione
+MAX_CALL_ARGS = 8     # argomenti tipizzati (i32/i64/f32/f64) per chiamata, come nel firmware
+
+
+def to_u32(v: int) -> int:
+    return v & 0xFFFFFFFF
+
+
+def to_i32(v: int) -> int:
+    v &= 0xFFFFFFFF
+    return v - (1 << 32) if v & 0x80000000 else v
+
+
+def to_i64(v: int) -> int:
+    v &= 0xFFFFFFFFFFFFFFFF
+    return v - (1 << 64) if v & (1 << 63) else v
+
+
+class FakeAgent:
+    def __init__(self, exec_ms: float, toggle_ms: float, baud: int,
+                 cpu_mhz: float = 180.0, aot_speedup: float = 4.0):
+        self.exec_ms = exec_ms       # costo fisso simulato di ogni chiamata (tier interp)
+        self.toggle_ms = toggle_ms   # durata simulata di gpio_toggle (k_msleep nel firmware)
+        self.baud = baud             # 0 = nessuna limitazione di banda della "UART"
+        self.cpu_mhz = cpu_mhz       # frequenza usata per riportare cycles= nel RESULT
+        self.aot_speedup = aot_speedup   # quanto è più veloce exec_ms con un modulo AOT
+
+        self.lock = threading.Lock()
+        self.conn = None             # client attualmente collegato (la "UART")
+        self.module_id = ""
+        self.module_loaded = False
+        self.module_tier = "interp"
+        self.version = 0             # progressivo dei LOAD, come nel firmware
+        self.retiring = 0            # versione ancora usata da un job in corso dopo un LOAD
+
+        # un runner per classe di priorità: coda EDF e job in esecuzione (modulo/tier/versione
+        # fissati da START). Le classi girano in parallelo, come i thread RUNNER del firmware
+        self.cond = threading.Condition(self.lock)
+        self.runners = [{"cls": c, "queue": [], "busy": False, "stop": False, "job": None,
+                         "since": 0.0} for c in range(len(PRIO_CLASSES))]
+        self.next_job_id = 1
+        self.exec_avg_us = {}        # durata media per funzione (stima dell'attesa in START_OK)
+        self.tls = threading.local() # runner del thread corrente (per should_stop)
+
+        # SCHEDULE: sched_id -> dict, ring dei risultati per FETCH
+        self.schedules = {}
+        self.next_sched_id = 1
+        self.results = collections.deque()
+        self.results_dropped = 0
+
+        # funzioni esportate simulate: nome -> (callable(argv) -> lista risultati, params, results)
+        self.functions = {
+            "add": (self.fn_add, ("i32", "i32"), ("i32",)),
+            "sum_to_n": (self.fn_sum_to_n, ("i32",), ("i32",)),
+            "toggle_n": (self.fn_toggle_n, ("i32",), ()),
+            "toggle_forever": (self.fn_toggle_forever, (), ()),
+            "scale": (self.fn_scale, ("f64", "f32"), ("f64",)),
+            "mul64": (self.fn_mul64, ("i64", "i64"), ("i64",)),
+            "divmod": (self.fn_divmod, ("i32", "i32"), ("i32", "i32")),
+        }
+
+        for runner in self.runners:
+            threading.Thread(target=self.runner_loop, args=(runner,), daemon=True).start()
+
+    # Funzioni simulate
+
+    def fn_add(self, argv):
+        return [to_i32(argv[0] + argv[1])]
+
+    def fn_sum_to_n(self, argv):
+        n = argv[0]
+        if n <= 0:
+            return [0]
+        return [to_i32(n * (n + 1) // 2)]
+
+    def fn_toggle_n(self, argv):
+        for _ in range(max(argv[0], 0)):
+            time.sleep(self.toggle_ms / 1000.0)
+        return []
+
+    def fn_toggle_forever(self, argv):
+        while not self.tls.runner["stop"]:
+            time.sleep(self.toggle_ms / 1000.0)
+        return []
+
+    def fn_scale(self, argv):
+        return [argv[0] * argv[1]]
+
+    def fn_mul64(self, argv):
+        return [to_i64(argv[0] * argv[1])]
+
+    def fn_divmod(self, argv):
+        a, b = argv
+        if b == 0:
+            raise ZeroDivisionError("integer divide by zero")
+        q = int(a / b)   # troncamento verso zero, come i32.div_s
+        return [to_i32(q), to_i32(a - q * b)]
+
+    # I/O
+
+    def uart_delay(self, nbytes: int):
+        if self.baud > 0:
+            time.sleep(nbytes * 10.0 / self.baud)   # 8N1: 10 bit per byte
+
+    def write_str(self, text: str):
+        data = text.encode("ascii")
+        self.uart_delay(len(data))
+        conn = self.conn
+        if conn is None:
+            return   # nessuno collegato: come la UART, i byte vanno persi
+        try:
+            conn.sendall(data)
+        except OSError:
+            pass
+
+    # Comandi
+
+    def handle_line(self, line: str, reader):
+        parts = line.split(" ", 1)
+        cmd = parts[0]
+        rest = parts[1] if len(parts) > 1 else ""
+
+        if cmd == "LOAD":
+            self.handle_load(rest, reader)
+        elif cmd == "START":
+            self.handle_start(rest)
+        elif cmd == "SIGS":
+            self.handle_sigs()
+        elif cmd == "STOP":
+            self.handle_stop(rest)
+        elif cmd == "STATUS":
+            self.handle_status()
+        elif cmd == "SCHEDULE":
+            self.handle_schedule(rest)
+        elif cmd == "UNSCHEDULE":
+            self.handle_unschedule(rest)
+        elif cmd == "FETCH":
+            self.handle_fetch(rest)
+        else:
+            self.write_str("ERROR code=UNKNOWN_COMMAND\n")
+
+    def handle_load(self, rest: str, reader):
+        params = parse_params(rest)
+        if "size" not in params:
+            self.write_str("LOAD_ERR code=BAD_PARAMS msg=\"missing size\"\n")
+            return
+        if "crc32" not in params:
+            self.write_str("LOAD_ERR code=BAD_PARAMS msg=\"missing crc32\"\n")
+            return
+        try:
+            size = int(params["size"])
+        except ValueError:
+            size = 0
+        if size == 0:
+            self.write_str("LOAD_ERR code=BAD_PARAMS msg=\"size=0\"\n")
+            return
+        crc_expected = int(params["crc32"], 16)
+
+        # la versione attiva resta in servizio finché la nuova non è caricata
+        self.write_str(f"LOAD_READY size={size} crc32={params['crc32']}\n")
+
+        t0 = time.perf_counter()
+        data = reader.read_exact(size, timeout=5.0)
+        if data is None:
+            self.write_str("LOAD_ERR code=TIMEOUT msg=\"binary payload not received\"\n")
+            return
+        # la UART reale non riceve più veloce del baud rate
+        if self.baud > 0:
+            remaining = size * 10.0 / self.baud - (time.perf_counter() - t0)
+            if remaining > 0:
+                time.sleep(remaining)
+
+        crc_calc = binascii.crc32(data) & 0xFFFFFFFF
+        if crc_calc != crc_expected:
+            self.write_str(f"LOAD_ERR code=BAD_CRC msg=\"expected={crc_expected:08x} "
+                           f"got={crc_calc:08x}\"\n")
+            return
+        if not (data.startswith(WASM_MAGIC) or data.startswith(AOT_MAGIC)):
+            self.write_str("LOAD_ERR code=LOAD_FAIL msg=\"magic header not detected\"\n")
+            return
+
+        with self.lock:
+            self.module_id = params.get("module_id", "")[:31]
+            self.module_loaded = True
+            self.module_tier = "aot" if data.startswith(AOT_MAGIC) else "interp"
+            self.version += 1
+            # hot swap: i job in corso (e in coda) finiscono sulla versione precedente
+            in_use = [r["job"]["version"] for r in self.runners if r["busy"]]
+            in_use += [j["version"] for r in self.runners for j in r["queue"]]
+            if in_use and not self.retiring:
+                self.retiring = max(in_use)
+            retiring = f" retiring={self.retiring}" if self.retiring else ""
+            out = f"LOAD_OK tier={self.module_tier} version={self.version}{retiring}\n"
+        self.write_str(out)
+
+    def handle_start(self, rest: str):
+        params = parse_params(rest)
+        with self.lock:
+            if not self.module_loaded:
+                self.write_str("RESULT status=NO_MODULE\n")
+                return
+            if "module_id" not in params:
+                self.write_str("RESULT status=BAD_PARAMS msg=\"missing module_id\"\n")
+                return
+            if params["module_id"] != self.module_id:
+                self.write_str("RESULT status=NO_MODULE msg=\"module_id mismatch\"\n")
+                return
+            if "func" not in params:
+                self.write_str("RESULT status=BAD_PARAMS msg=\"missing func\"\n")
+                return
+            prio = params.get("prio", "normal")
+            if prio not in PRIO_CLASSES:
+                self.write_str("RESULT status=BAD_PARAMS msg=\"prio must be high, normal or low\"\n")
+                return
+            func_name = params["func"][:63]
+            fn = self.functions.get(func_name)
+            if fn is None:
+                self.write_str(f"RESULT status=NO_FUNC name={func_name}\n")
+                return
+            argv, err = parse_call_args(params, fn[1])
+            if err:
+                self.write_str(f"RESULT status=BAD_PARAMS func={func_name} msg=\"{err}\"\n")
+                return
+
+            deadline_ms = max(atoi(params.get("deadline_ms", "0")), 0)
+            now = time.monotonic()
+            runner = self.runners[PRIO_CLASSES.index(prio)]
+            job = {
+                "id": self.next_job_id,
+                "func": func_name,
+                "fn": fn,
+                "argv": argv,
+                "module_id": self.module_id,
+                "tier": self.module_tier,
+                "version": self.version,
+                "deadline": now + deadline_ms / 1000.0 if deadline_ms else None,
+            }
+            self.next_job_id += 1
+
+            # admission control: attesa stimata = resto del job in corso + job che l'EDF serve prima
+            ahead, wait_ms = 0, 0
+            if runner["busy"]:
+                est = self.exec_avg_us.get(runner["job"]["func"], 0) / 1000.0
+                wait_ms += max(0, int(est - (now - runner["since"]) * 1000.0))
+                ahead += 1
+            for queued in runner["queue"]:
+                if edf_key(queued) < edf_key(job):
+                    wait_ms += int(self.exec_avg_us.get(queued["func"], 0) / 1000.0)
+                    ahead += 1
+            exec_ms = int(self.exec_avg_us.get(func_name, 0) / 1000.0)
+
+            if len(runner["queue"]) >= JOB_QUEUE_LEN:
+                self.write_str(f"RESULT status=BUSY prio={prio} queued={len(runner['queue'])} "
+                               f"expected_wait_ms={wait_ms}\n")
+                return
+            if deadline_ms and wait_ms + exec_ms > deadline_ms:
+                self.write_str(f"RESULT status=REJECTED reason=DEADLINE prio={prio} "
+                               f"expected_wait_ms={wait_ms} est_exec_ms={exec_ms}\n")
+                return
+
+            # START_OK sotto lock: il runner non può prelevare il job (e inviare RESULT) prima
+            runner["queue"].append(job)
+            self.write_str(f"START_OK job_id={job['id']} prio={prio} ahead={ahead} "
+                           f"expected_wait_ms={wait_ms}\n")
+            self.cond.notify_all()
+
+    def runner_loop(self, runner):
+        self.tls.runner = runner
+        prio = PRIO_CLASSES[runner["cls"]]
+        while True:
+            with self.cond:
+                # nel runner normal può girare un tick di SCHEDULE
+                while not runner["queue"] or runner["busy"]:
+                    self.cond.wait()
+                job = min(runner["queue"], key=edf_key)
+                runner["queue"].remove(job)
+                runner["busy"] = True
+                runner["stop"] = False
+                runner["job"] = job
+                runner["since"] = time.monotonic()
+            self.run_job(runner, job, prio)
+            with self.lock:
+                runner["busy"] = False
+                runner["stop"] = False
+                runner["job"] = None
+                if not any(r["busy"] or r["queue"] for r in self.runners):
+                    self.retiring = 0
+
+    def run_job(self, runner, job, prio):
+        tail = f"job_id={job['id']} prio={prio}"
+        late_s = time.monotonic() - job["deadline"] if job["deadline"] is not None else 0
+        if late_s > 0:
+            # deadline già scaduta in coda: il job non parte
+            self.write_str(f"RESULT status=EXPIRED func={job['func']} {tail} "
+                           f"late_ms={int(late_s * 1000)}\n")
+            return
+        tier = job["tier"]
+        exec_ms = self.exec_ms / self.aot_speedup if tier == "aot" else self.exec_ms
+        t0 = time.perf_counter()
+        time.sleep(exec_ms / 1000.0)
+        func_name = job["func"]
+        fn, _, result_types = job["fn"]
+        try:
+            ret = fn(job["argv"])
+        except ArithmeticError as e:
+            ret = None
+            out = f"RESULT status=EXCEPTION func={func_name} msg=\"Exception: {e}\""
+        exec_us = int((time.perf_counter() - t0) * 1e6)
+        if runner["stop"]:
+            out = f"RESULT status=STOPPED func={func_name}"
+        elif ret is not None:
+            out = f"RESULT status=OK func={func_name}{format_results(result_types, ret)}"
+        with self.lock:
+            avg = self.exec_avg_us.get(func_name)
+            self.exec_avg_us[func_name] = exec_us if avg is None else avg - avg // 4 + exec_us // 4
+        miss = (" deadline_miss=1" if job["deadline"] is not None
+                and time.monotonic() > job["deadline"] else "")
+        # stessa coda del firmware: job, tier e misure del job (cycles a 32 bit, va in overflow)
+        cycles = to_u32(int(exec_us * self.cpu_mhz))
+        self.write_str(f"{out} {tail} tier={tier} version={job['version']} "
+                       f"cycles={cycles} exec_us={to_u32(exec_us)}{miss}\n")
+
+    def handle_stop(self, rest: str):
+        params = parse_params(rest)
+        module_id = params.get("module_id")
+        job_id = atoi(params.get("job_id", "0"))
+        running, dequeued = 0, []
+        with self.lock:
+            any_busy = any(r["busy"] for r in self.runners)
+            for r in self.runners:
+                if module_id is None:
+                    continue
+                job = r["job"]
+                if (r["busy"] and job is not None and job["module_id"] == module_id
+                        and (not job_id or job["id"] == job_id)):
+                    r["stop"] = True
+                    running += 1
+                keep = []
+                for q in r["queue"]:
+                    if q["module_id"] == module_id and (not job_id or q["id"] == job_id):
+                        dequeued.append(q)
+                    else:
+                        keep.append(q)
+                r["queue"] = keep
+        if running:
+            self.write_str("STOP_OK status=PENDING\n")
+        elif dequeued:
+            self.write_str(f"STOP_OK status=DEQUEUED count={len(dequeued)}\n")
+        else:
+            self.write_str("STOP_OK status=NO_JOB\n" if any_busy else "STOP_OK status=IDLE\n")
+        for q in dequeued:
+            self.write_str(f"RESULT status=STOPPED func={q['func']} job_id={q['id']} queued=1\n")
+
+    def handle_sigs(self):
+        with self.lock:
+            if not self.module_loaded:
+                self.write_str("SIGS_ERR code=NO_MODULE\n")
+                return
+            module_id, version = self.module_id, self.version
+        for name, (_, params, results) in self.functions.items():
+            self.write_str(f"SIG func={name} params={','.join(params) or '-'} "
+                           f"results={','.join(results) or '-'}\n")
+        self.write_str(f"SIGS_OK module_id={module_id} version={version} count={len(self.functions)}\n")
+
+    def handle_status(self):
+        with self.lock:
+            busy = [r["busy"] for r in self.runners]
+            queued = [len(r["queue"]) for r in self.runners]
+            runner = "RUNNING" if any(busy) else "IDLE"
+            if not self.module_loaded:
+                self.write_str(f"STATUS_OK modules=\"none\" runner={runner}\n")
+                return
+            retiring = f" retiring={self.retiring}" if self.retiring else ""
+            out = (f"STATUS_OK modules=\"wasm_module(loaded)\" module_id={self.module_id} runner={runner} "
+                   f"tier={self.module_tier} version={self.version}{retiring}")
+            if self.schedules or self.results:
+                out += f" schedules={len(self.schedules)} results={len(self.results)}"
+            if any(busy) or any(queued):
+                flags = "".join(f for f, b in zip("HNL", busy) if b) or "-"
+                out += f" busy={flags} queued={','.join(str(q) for q in queued)}"
+        self.write_str(out + "\n")
+
+    # SCHEDULE / UNSCHEDULE / FETCH: un thread timer per schedule; un tick che trova
+    # il runner normal occupato viene contato come missed (il firmware lo accorpa al successivo)
+
+    def handle_schedule(self, rest: str):
+        params = parse_params(rest)
+        if "module_id" not in params or "func" not in params:
+            self.write_str("SCHEDULE_ERR code=BAD_PARAMS msg=\"missing module_id or func\"\n")
+            return
+        period_ms = atoi(params.get("period_ms", "0"))
+        delay_ms = atoi(params.get("delay_ms", str(period_ms)))
+        max_runs = atoi(params.get("max_runs", "0"))
+        if period_ms <= 0 and delay_ms <= 0:
+            self.write_str("SCHEDULE_ERR code=BAD_PARAMS msg=\"missing period_ms or delay_ms\"\n")
+            return
+        if period_ms <= 0:
+            max_runs = 1
+        if params.get("mode", "batch") not in ("batch", "stream"):
+            self.write_str("SCHEDULE_ERR code=BAD_PARAMS msg=\"mode must be batch or stream\"\n")
+            return
+        func_name = params["func"][:63]
+        with self.lock:
+            if not self.module_loaded or params["module_id"] != self.module_id:
+                self.write_str("SCHEDULE_ERR code=NO_MODULE\n")
+                return
+            if func_name not in self.functions:
+                self.write_str(f"SCHEDULE_ERR code=NO_FUNC name={func_name}\n")
+                return
+            argv, err = parse_call_args(params, self.functions[func_name][1])
+            if err:
+                self.write_str(f"SCHEDULE_ERR code=BAD_PARAMS msg=\"{err}\"\n")
+                return
+            if len(self.schedules) >= MAX_SCHEDULES:
+                self.write_str("SCHEDULE_ERR code=NO_SLOT\n")
+                return
+            sched = {
+                "id": self.next_sched_id,
+                "module_id": params["module_id"],
+                "func": func_name,
+                "argv": argv,
+                "period_ms": period_ms,
+                "max_runs": max_runs,
+                "stream": params.get("mode") == "stream",
+                "runs": 0,
+                "missed": 0,
+            }
+            self.next_sched_id += 1
+            self.schedules[sched["id"]] = sched
+        threading.Thread(target=self.schedule_loop, args=(sched, delay_ms),
+                         daemon=True).start()
+        self.write_str(f"SCHEDULE_OK sched_id={sched['id']}\n")
+
+    def schedule_loop(self, sched, delay_ms):
+        runner = self.runners[PRIO_NORMAL]
+        self.tls.runner = runner
+        next_tick = time.perf_counter() + delay_ms / 1000.0
+        while True:
+            time.sleep(max(0.0, next_tick - time.perf_counter()))
+            with self.lock:
+                if self.schedules.get(sched["id"]) is not sched:
+                    return
+                if runner["busy"]:
+                    if sched["period_ms"]:
+                        sched["missed"] += 1
+                    claimed = False
+                else:
+                    runner["busy"] = True
+                    runner["stop"] = False
+                    runner["job"] = {"id": 0, "func": sched["func"], "sched_id": sched["id"],
+                                     "module_id": sched["module_id"]}
+                    runner["since"] = time.monotonic()
+                    claimed = True
+                loaded = self.module_loaded and self.module_id == sched["module_id"]
+                tier, version = self.module_tier, self.version
+            if claimed:
+                self.run_scheduled(sched, loaded, tier)
+                if sched["max_runs"] and sched["runs"] >= sched["max_runs"]:
+                    with self.lock:
+                        self.schedules.pop(sched["id"], None)
+                    return
+            if not sched["period_ms"]:
+                if claimed:
+                    return
+                next_tick = time.perf_counter() + 0.001   # one-shot: riprova appena il runner è libero
+                continue
+            next_tick += sched["period_ms"] / 1000.0
+
+    def run_scheduled(self, sched, loaded, tier):
+        t0 = time.perf_counter()
+        ret = None
+        fn, _, result_types = self.functions[sched["func"]]
+        if loaded:
+            exec_ms = self.exec_ms / self.aot_speedup if tier == "aot" else self.exec_ms
+            time.sleep(exec_ms / 1000.0)
+            try:
+                ret = fn(sched["argv"])
+                status = "STOPPED" if self.tls.runner["stop"] else "OK"
+            except ArithmeticError:
+                status = "EXCEPTION"
+        else:
+            status = "NO_MODULE"
+        exec_us = int((time.perf_counter() - t0) * 1e6)
+        with self.lock:
+            sched["runs"] += 1
+            line = (f"SRESULT sched_id={sched['id']} seq={sched['runs']} "
+                    f"t_ms={to_u32(int(time.monotonic() * 1000))} status={status}")
+            if ret is not None and status == "OK":
+                line += format_results(result_types, ret)
+            line += f" cycles={to_u32(int(exec_us * self.cpu_mhz))} exec_us={exec_us}\n"
+            if not sched["stream"]:
+                if len(self.results) >= SCHED_RESULTS:
+                    self.results.popleft()
+                    self.results_dropped += 1
+                self.results.append(line)
+            runner = self.tls.runner
+            runner["busy"] = False
+            runner["stop"] = False
+            runner["job"] = None
+            self.cond.notify_all()
+        if sched["stream"]:
+            self.write_str(line)
+
+    def handle_unschedule(self, rest: str):
+        params = parse_params(rest)
+        with self.lock:
+            sched = self.schedules.pop(atoi(params.get("sched_id", "0")), None)
+            runner = self.runners[PRIO_NORMAL]
+            job = runner["job"]
+            if sched is not None and runner["busy"] and job and job.get("sched_id") == sched["id"]:
+                runner["stop"] = True
+        if sched is None:
+            self.write_str("UNSCHEDULE_ERR code=NOT_FOUND\n")
+            return
+        self.write_str(f"UNSCHEDULE_OK sched_id={sched['id']} runs={sched['runs']} "
+                       f"missed={sched['missed']}\n")
+
+    def handle_fetch(self, rest: str):
+        params = parse_params(rest)
+        max_n = atoi(params.get("max", str(SCHED_RESULTS)))
+        count = 0
+        while count < max_n:
+            with self.lock:
+                if not self.results:
+                    break
+                line = self.results.popleft()
+            self.write_str(line)
+            count += 1
+        with self.lock:
+            pending, dropped = len(self.results), self.results_dropped
+            self.results_dropped = 0
+        self.write_str(f"FETCH_OK count={count} pending={pending} dropped={dropped}\n")
+
+
+# Ordine EDF: deadline più vicina prima, senza deadline in fondo, a parità l'arrivo (job_id)
+
+def edf_key(job):
+    return (job["deadline"] is None, job["deadline"] or 0.0, job["id"])
+
+
+# Argomenti convertiti con la firma della funzione, come parse_call_args del firmware (stessa
+# sintassi di strtoll/strtod, condivisa con il controllo del gateway):
+# ritorna (argv, None) oppure (None, messaggio d'errore)
+
+def parse_call_args(params: dict, param_types) -> tuple:
+    values = [tok.split("=", 1)[1] for tok in params.get("args", "").split(",") if "=" in tok]
+    if len(values) != len(param_types):
+        return None, f"expected {len(param_types)} args, got {len(values)}"
+    argv = []
+    for i, (text, kind) in enumerate(zip(values, param_types)):
+        try:
+            v = parse_wasm_value(text, kind)
+        except (ValueError, OverflowError):
+            return None, f"bad {kind} value for arg {i + 1}"
+        argv.append(to_i32(v) if kind == "i32" else to_i64(v) if kind == "i64" else v)
+    return argv, None
+
+
+# Risultati come nel firmware: un solo i32 resta ret_i32=<u32>, altrimenti ret=... ret_types=...
+
+def format_results(result_types, values) -> str:
+    if not result_types:
+        return ""
+    if tuple(result_types) == ("i32",):
+        return f" ret_i32={to_u32(values[0])}"
+    text = []
+    for kind, v in zip(result_types, values):
+        if kind == "f32":
+            text.append(f"{v:.9g}")
+        elif kind == "f64":
+            text.append(f"{v:.17g}")
+        else:
+            text.append(str(v))
+    return f" ret={','.join(text)} ret_types={','.join(result_types)}"
+
+
+# Parsing key=value, con args="..." tra virgolette come nel firmware
+
+def parse_params(rest: str) -> dict:
+    params = {}
+    i = 0
+    n = len(rest)
+    while i < n:
+        while i < n and rest[i] == " ":
+            i += 1
+        eq = rest.find("=", i)
+        if eq < 0:
+            break
+        key = rest[i:eq]
+        j = eq + 1
+        if j < n and rest[j] == "\"":
+            end = rest.find("\"", j + 1)
+            end = n if end < 0 else end
+            params[key] = rest[j + 1:end]
+            i = end + 1
+        else:
+            end = rest.find(" ", j)
+            end = n if end < 0 else end
+            params[key] = rest[j:end]
+            i = end
+    return params
+
+
+def atoi(text: str) -> int:
+    # come atoi(): prefisso numerico opzionale con segno, 0 se assente
+    text = text.strip()
+    sign = 1
+    if text[:1] in ("+", "-"):
+        sign = -1 if text[0] == "-" else 1
+        text = text[1:]
+    digits = ""
+    for c in text:
+        if not c.isdigit():
+            break
+        digits += c
+    return sign * int(digits) if digits else 0
+
+
+class ConnReader:
+    """Legge righe e blocchi binari dalla socket del client, con buffer condiviso."""
+
+    def __init__(self, conn):
+        self.conn = conn
+        self.buf = bytearray()
+
+    def _fill(self, timeout: float) -> bool:
+        self.conn.settimeout(timeout)
+        try:
+            chunk = self.conn.recv(4096)
+        except socket.timeout:
+            return True
+        if not chunk:
+            return False
+        self.buf += chunk
+        return True
+
+    def read_line(self):
+        while True:
+            for i, b in enumerate(self.buf):
+                if b in (0x0A, 0x0D):
+                    line = bytes(self.buf[:i])
+                    del self.buf[:i + 1]
+                    if line:
+                        return line[:LINE_BUF_SIZE - 1].decode("ascii", errors="ignore")
+                    break
+            else:
+                if not self._fill(None):
+                    return None
+                continue
+            # riga vuota (es. \r\n): scarta e riprova
+
+    def read_exact(self, size: int, timeout: float):
+        deadline = time.time() + timeout
+        while len(self.buf) < size:
+            left = deadline - time.time()
+            if left <= 0:
+                return None
+            if not self._fill(left):
+                return None
+        data = bytes(self.buf[:size])
+        del self.buf[:size]
+        return data
+
+
+def serve(agent: FakeAgent, host: str, port: int):
+    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
+        s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        s.bind((host, port))
+        s.listen(5)
+        print(f"Fake agent listening on {host}:{port}")
+        while True:
+            conn, _ = s.accept()
+            conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            threading.Thread(target=client_loop, args=(agent, conn),
+                             daemon=True).start()
+
+
+def client_loop(agent: FakeAgent, conn):
+    # l'ultimo client collegato riceve l'output dell'agent (come il terminale socket di Renode)
+    agent.conn = conn
+    reader = ConnReader(conn)
+    try:
+        while True:
+            line = reader.read_line()
+            if line is None:
+                break
+            agent.handle_line(line, reader)
+    except OSError:
+        pass
+    finally:
+        if agent.conn is conn:
+            agent.conn = None
+        conn.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Agent simulato (protocollo LOAD/START/STOP/STATUS su TCP)"
+    )
+    parser.add_argument("--host", default="127.0.0.1", help="Host di ascolto")
+    parser.add_argument("--port", type=int, default=3460, help="Porta di ascolto")
+    parser.add_argument("--exec-ms", type=float, default=0.0,
+                        help="Costo simulato di ogni chiamata (ms)")
+    parser.add_argument("--toggle-ms", type=float, default=1000.0,
+                        help="Durata simulata di gpio_toggle (ms, come SLEEP_TIME_MS)")
+    parser.add_argument("--baud", type=int, default=0,
+                        help="Baud rate simulato della UART (0 = illimitato, es. 115200)")
+    parser.add_argument("--cpu-mhz", type=float, default=180.0,
+                        help="Frequenza CPU simulata per cycles= nel RESULT (STM32F446: 180)")
+    parser.add_argument("--aot-speedup", type=float, default=4.0,
+                        help="Fattore di riduzione di --exec-ms quando il modulo caricato è AOT")
+    args = parser.parse_args()
+    serve(FakeAgent(args.exec_ms, args.toggle_ms, args.baud, args.cpu_mhz, args.aot_speedup),
+          args.host, args.port)
+
+
+if __name__ == "__main__":
+    main()
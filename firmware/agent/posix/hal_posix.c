@@ -0,0 +1,453 @@
+/*
+    HAL POSIX dell'agent: stesso core (agent.c) e stesso protocollo del firmware,
+    ma il canale comandi è una socket TCP (come il bridge Renode su USART2) e
+    i thread COMM/RUNNER (uno per classe di priorità) sono pthread. Serve per iterare e fare benchmark
+    (interprete vs AOT, throughput del protocollo) alla velocità dell'host.
+
+    Uso:
+        agent_posix [--port 3457] [--toggle-ms 1000] [--device-id native_01]
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "agent.h"
+#include "hal.h"
+
+
+#define DEFAULT_PORT       3457
+#define DEFAULT_TOGGLE_MS  1000   // come SLEEP_TIME_MS nel firmware
+
+static int         g_listen_fd = -1;
+static int         g_client_fd = -1;     // client attualmente collegato (il "cavo seriale")
+static uint32_t    g_toggle_ms = DEFAULT_TOGGLE_MS;
+static const char *g_device_id = "native_01";
+static bool        g_led_on    = false;
+
+// più thread scrivono sul canale (COMM e RUNNER): una riga alla volta.
+// I due mutex hanno priority inheritance come i k_mutex del firmware (init_locks)
+static pthread_mutex_t g_tx_lock;
+
+// registry dei moduli (hot swap tra COMM e RUNNER)
+static pthread_mutex_t g_registry_lock;
+
+// priorità SCHED_FIFO speculari a quelle Zephyr (COMM 5, RUNNER high/normal/low 6/7/8): su Linux
+// il numero più alto è il più urgente, quindi la scala è rovesciata. I timer degli SCHEDULE,
+// che sul firmware scadono in ISR, stanno sopra tutti
+#define TIMER_FIFO_PRIORITY  12
+#define COMM_FIFO_PRIORITY   11
+static const int runner_fifo_priority[AGENT_PRIO_CLASSES] = { 10, 9, 8 };
+
+static bool g_fifo = false;   // true se il processo ha i privilegi per SCHED_FIFO (root o CAP_SYS_NICE)
+
+// buffer RX condiviso tra righe di testo e payload binario (possono arrivare nello stesso segmento TCP)
+static uint8_t g_rx_buf[4096];
+static size_t  g_rx_len = 0;
+
+// payload binario atteso (hal_binary_arm)
+static uint8_t *g_bin_buf      = NULL;
+static size_t   g_bin_expected = 0;
+
+// un semaforo per RUNNER (classe di priorità)
+static sem_t run_sems[AGENT_PRIO_CLASSES];
+
+// timer degli SCHEDULE: timer POSIX con notifica su thread (SIGEV_THREAD)
+static timer_t g_sched_timers[AGENT_MAX_SCHEDULES];
+static bool    g_sched_timer_created[AGENT_MAX_SCHEDULES];
+
+
+const char *hal_device_id(void)
+{
+    return g_device_id;
+}
+
+const char *hal_rtos_name(void)
+{
+    return "POSIX";
+}
+
+void hal_gpio_toggle(void)
+{
+    g_led_on = !g_led_on;   // LED simulato
+    if (g_toggle_ms > 0) {
+        usleep(g_toggle_ms * 1000u);
+    }
+}
+
+// Sull'host non c'è un contatore di cicli portabile: si usano i nanosecondi (stessa semantica di differenza a 32 bit)
+uint32_t hal_cycle_count(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec);
+}
+
+uint32_t hal_uptime_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000u);
+}
+
+uint32_t hal_uptime_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000u);
+}
+
+void hal_runner_notify(int prio_class)
+{
+    sem_post(&run_sems[prio_class]);
+}
+
+void hal_runner_wait(int prio_class)
+{
+    while (sem_wait(&run_sems[prio_class]) != 0 && errno == EINTR) {
+    }
+}
+
+void hal_registry_lock(void)
+{
+    pthread_mutex_lock(&g_registry_lock);
+}
+
+void hal_registry_unlock(void)
+{
+    pthread_mutex_unlock(&g_registry_lock);
+}
+
+// Attributi di un thread SCHED_FIFO a priorità 'prio' (da distruggere con pthread_attr_destroy)
+static void fifo_attr_init(pthread_attr_t *attr, int prio)
+{
+    struct sched_param sp;
+    memset(&sp, 0, sizeof(sp));
+    sp.sched_priority = prio;
+
+    pthread_attr_init(attr);
+    pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(attr, SCHED_FIFO);
+    pthread_attr_setschedparam(attr, &sp);
+}
+
+static void sched_timer_notify(union sigval sv)
+{
+    agent_timer_expired(sv.sival_int);
+}
+
+void hal_timer_start(int id, uint32_t delay_ms, uint32_t period_ms)
+{
+    if (!g_sched_timer_created[id]) {
+        struct sigevent sev;
+        memset(&sev, 0, sizeof(sev));
+        sev.sigev_notify          = SIGEV_THREAD;
+        sev.sigev_notify_function = sched_timer_notify;
+        sev.sigev_value.sival_int = id;
+
+        pthread_attr_t attr;
+        if (g_fifo) {
+            fifo_attr_init(&attr, TIMER_FIFO_PRIORITY);
+            sev.sigev_notify_attributes = &attr;
+        }
+        int rc = timer_create(CLOCK_MONOTONIC, &sev, &g_sched_timers[id]);
+        if (g_fifo) {
+            pthread_attr_destroy(&attr);
+        }
+        if (rc != 0) {
+            perror("timer_create");
+            return;
+        }
+        g_sched_timer_created[id] = true;
+    }
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec     = delay_ms / 1000u;
+    its.it_value.tv_nsec    = (long)(delay_ms % 1000u) * 1000000L;
+    its.it_interval.tv_sec  = period_ms / 1000u;
+    its.it_interval.tv_nsec = (long)(period_ms % 1000u) * 1000000L;
+    if (delay_ms == 0) {
+        its.it_value.tv_nsec = 1;   // it_value a zero disarmerebbe il timer
+    }
+    timer_settime(g_sched_timers[id], 0, &its, NULL);
+}
+
+void hal_timer_stop(int id)
+{
+    if (g_sched_timer_created[id]) {
+        struct itimerspec its;
+        memset(&its, 0, sizeof(its));
+        timer_settime(g_sched_timers[id], 0, &its, NULL);
+    }
+}
+
+void hal_write_str(const char *s)
+{
+    if (!s) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_tx_lock);
+    if (g_client_fd >= 0) {
+        size_t len = strlen(s);
+        size_t off = 0;
+        while (off < len) {
+            ssize_t n = send(g_client_fd, s + off, len - off, MSG_NOSIGNAL);
+            if (n <= 0) {
+                break;   // client disconnesso: come la UART, i byte vanno persi
+            }
+            off += (size_t)n;
+        }
+    }
+    pthread_mutex_unlock(&g_tx_lock);
+}
+
+// Chiude il client corrente; il prossimo hal_read_line accetta una nuova connessione
+static void drop_client(void)
+{
+    pthread_mutex_lock(&g_tx_lock);
+    if (g_client_fd >= 0) {
+        close(g_client_fd);
+        g_client_fd = -1;
+    }
+    pthread_mutex_unlock(&g_tx_lock);
+    g_rx_len = 0;
+}
+
+// Riempie il buffer RX; timeout_ms < 0 = attesa infinita. 1 = dati, 0 = timeout, -1 = client chiuso
+static int fill_rx(int timeout_ms)
+{
+    if (g_client_fd < 0) {
+        if (timeout_ms >= 0) {
+            return -1;
+        }
+        int fd = accept(g_listen_fd, NULL, NULL);   // un client alla volta, come il terminale socket di Renode
+        if (fd < 0) {
+            return 0;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        pthread_mutex_lock(&g_tx_lock);
+        g_client_fd = fd;
+        pthread_mutex_unlock(&g_tx_lock);
+    }
+
+    if (g_rx_len >= sizeof(g_rx_buf)) {
+        return 1;
+    }
+
+    struct pollfd pfd = { .fd = g_client_fd, .events = POLLIN };
+    int pr = poll(&pfd, 1, timeout_ms);
+    if (pr == 0) {
+        return 0;
+    }
+    if (pr < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    ssize_t n = recv(g_client_fd, g_rx_buf + g_rx_len, sizeof(g_rx_buf) - g_rx_len, 0);
+    if (n <= 0) {
+        drop_client();
+        return -1;
+    }
+    g_rx_len += (size_t)n;
+    return 1;
+}
+
+static void consume_rx(size_t n)
+{
+    memmove(g_rx_buf, g_rx_buf + n, g_rx_len - n);
+    g_rx_len -= n;
+}
+
+int hal_read_line(char *buf, size_t max_len)
+{
+    if (!buf || max_len == 0) {
+        return -1;
+    }
+
+    for (;;) {
+        for (size_t i = 0; i < g_rx_len; i++) {
+            if (g_rx_buf[i] == '\n' || g_rx_buf[i] == '\r') {
+                size_t len = i < max_len - 1 ? i : max_len - 1;   // righe troppo lunghe vengono troncate
+                memcpy(buf, g_rx_buf, len);
+                buf[len] = '\0';
+                consume_rx(i + 1);
+                if (len == 0) {
+                    break;   // riga vuota (es. \r\n): come l'ISR, la ignora
+                }
+                return (int)len;
+            }
+        }
+        if (g_rx_len >= sizeof(g_rx_buf)) {
+            g_rx_len = 0;   // riga senza terminatore più lunga del buffer: scartata
+        }
+        if (fill_rx(-1) < 0) {
+            continue;   // client chiuso: al giro successivo si accetta il prossimo
+        }
+    }
+}
+
+void hal_binary_arm(uint8_t *buf, size_t size)
+{
+    g_bin_buf      = buf;
+    g_bin_expected = size;
+}
+
+int hal_binary_wait(uint32_t timeout_ms)
+{
+    struct timespec t0, now;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    size_t received = 0;
+    while (received < g_bin_expected) {
+        if (g_rx_len > 0) {
+            size_t n = g_bin_expected - received;
+            if (n > g_rx_len) {
+                n = g_rx_len;
+            }
+            memcpy(g_bin_buf + received, g_rx_buf, n);
+            consume_rx(n);
+            received += n;
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed_ms = (now.tv_sec - t0.tv_sec) * 1000L
+                          + (now.tv_nsec - t0.tv_nsec) / 1000000L;
+        if (elapsed_ms >= (long)timeout_ms || fill_rx((int)(timeout_ms - elapsed_ms)) < 0) {
+            g_bin_buf = NULL;
+            return -1;
+        }
+    }
+
+    g_bin_buf = NULL;
+    return 0;
+}
+
+static void *runner_thread_entry(void *arg)
+{
+    agent_runner_loop((int)(intptr_t)arg);
+    return NULL;
+}
+
+static void init_locks(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&g_tx_lock, &attr);
+    pthread_mutex_init(&g_registry_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+// Il thread COMM (quello principale) passa a SCHED_FIFO; se non può, di solito EPERM senza
+// privilegi, anche RUNNER e timer restano con lo scheduler di default: i RUNNER non devono
+// mai stare sopra il COMM
+static void init_scheduling(void)
+{
+    struct sched_param sp;
+    memset(&sp, 0, sizeof(sp));
+    sp.sched_priority = COMM_FIFO_PRIORITY;
+
+    int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+    g_fifo = rc == 0;
+    if (rc != 0 && rc != EPERM) {
+        fprintf(stderr, "SCHED_FIFO: %s\n", strerror(rc));
+    }
+    printf("Scheduler: %s\n", g_fifo ? "SCHED_FIFO (priorities as on Zephyr)" : "default (no SCHED_FIFO privileges)");
+    fflush(stdout);
+}
+
+static int open_listen_socket(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = htons((uint16_t)port);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 1) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char **argv)
+{
+    int port = DEFAULT_PORT;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--toggle-ms") == 0 && i + 1 < argc) {
+            g_toggle_ms = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--device-id") == 0 && i + 1 < argc) {
+            g_device_id = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--port N] [--toggle-ms N] [--device-id ID]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    init_locks();
+
+    g_listen_fd = open_listen_socket(port);
+    if (g_listen_fd < 0) {
+        perror("listen");
+        return 1;
+    }
+    printf("Agent listening on 127.0.0.1:%d\n", port);
+    fflush(stdout);
+
+    if (!agent_runtime_init()) {
+        fprintf(stderr, "WAMR init failed\n");
+        return 1;
+    }
+
+    init_scheduling();
+
+    // un RUNNER per classe di priorità, in SCHED_FIFO sotto il COMM come su Zephyr: un job high
+    // prelaziona normal/low. Senza privilegi le priorità restano quelle del kernel: le classi
+    // girano comunque in parallelo, l'EDF resta dentro la classe
+    for (int c = 0; c < AGENT_PRIO_CLASSES; c++) {
+        sem_init(&run_sems[c], 0, 0);
+
+        pthread_t      runner;
+        pthread_attr_t attr;
+        fifo_attr_init(&attr, runner_fifo_priority[c]);
+        int rc = pthread_create(&runner, g_fifo ? &attr : NULL, runner_thread_entry, (void *)(intptr_t)c);
+        pthread_attr_destroy(&attr);
+        if (rc != 0) {
+            errno = rc;
+            perror("pthread_create");
+            return 1;
+        }
+    }
+
+    agent_comm_loop();   // thread COMM = thread principale, non ritorna
+    return 0;
+}
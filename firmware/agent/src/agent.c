@@ -0,0 +1,1975 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+
+// Header di WAMR (WebAssembly Micro Runtime): porting layer, assert/log, funzioni per caricare/eseguire moduli
+#include "bh_platform.h"
+#include "bh_assert.h"
+#include "bh_log.h"
+#include "wasm_export.h"
+
+#include "agent.h"
+#include "hal.h"
+
+
+// Argomenti e risultati di una chiamata Wasm, tipizzati con la firma dell'export (i32/i64/f32/f64)
+#define MAX_CALL_ARGS     8
+#define MAX_CALL_RESULTS  4
+
+// timeout ricezione payload binario di LOAD
+#define LOAD_PAYLOAD_TIMEOUT_MS  5000
+
+// Versioni del modulo che possono coesistere: quella attiva (riceve i nuovi START) e quelle
+// in ritiro, ancora usate dai job in corso (al massimo una per thread RUNNER)
+#define MODULE_VERSIONS  (AGENT_PRIO_CLASSES + 1)
+
+/*  Classi di priorità di START: ogni classe ha il suo thread RUNNER (priorità Zephyr decrescenti,
+    tutte sotto il COMM thread) e la sua coda, servita per deadline più vicina (EDF; senza deadline
+    in fondo, a parità in ordine di arrivo). Un job high interrompe così un job normal/low già
+    in esecuzione (es. toggle_forever), mentre i job della stessa classe restano serializzati.
+*/
+#define PRIO_HIGH       0
+#define PRIO_NORMAL     1
+#define PRIO_LOW        2
+
+#define JOB_QUEUE_LEN   4       // job in attesa per classe, oltre a quello in esecuzione
+#define EXEC_STATS      8       // funzioni di cui si tiene la durata media (stima dell'attesa in START_OK)
+
+static const char *const g_prio_names[AGENT_PRIO_CLASSES] = { "high", "normal", "low" };
+
+// Registry dei moduli: una versione caricata
+typedef struct {
+    char               module_id[32];  // ID logico del modulo (da LOAD module_id=...)
+    uint8_t           *buf;            // Module binary
+    uint32_t           size;
+    wasm_module_t      module;         // Parsed module
+    wasm_module_inst_t inst;           // Instance with memory (NULL se staged), usata dalla classe normal
+    wasm_module_inst_t class_inst[AGENT_PRIO_CLASSES];  // istanze proprie di high/low, create al primo START
+                                       // (due RUNNER non possono eseguire nella stessa istanza)
+    uint32_t           version;        // progressivo assegnato al LOAD, riportato in LOAD_OK/STATUS/RESULT
+    uint32_t           refs;           // job (in coda o in esecuzione) che stanno usando questa versione
+    bool               staged;         // istanziazione rimandata alla fine del job in corso (RAM insufficiente per 2 istanze)
+    bool               is_aot;         // tier di esecuzione: AOT precompilato oppure bytecode interpretato
+    bool               loaded;
+} module_slot_t;
+
+/*  Hot swap: LOAD riceve e istanzia la nuova versione in uno slot libero, poi la rende attiva
+    sotto hal_registry_lock(); i nuovi START vanno alla nuova versione, mentre i job in coda o in
+    corso tengono un riferimento (refs) alla vecchia, che il RUNNER scarica quando l'ultimo termina.
+    g_active e refs si modificano solo con il lock preso.
+*/
+static module_slot_t  g_slots[MODULE_VERSIONS];
+static module_slot_t *g_active       = NULL;
+static uint32_t       g_next_version = 1;
+
+//  definisce un typedef struct con le informazioni necessarie per chiedere al thread RUNNER di chiamare una funzione Wasm con argomenti tipizzati
+typedef struct {
+    char           func_name[64];       // Buffer per il nome della funzione esportata nel modulo Wasm da eseguire
+    uint32_t       argc;                // Numero di argomenti effettivi passati alla funzione
+    uint64_t       argv[MAX_CALL_ARGS]; // bit degli argomenti, nel tipo del parametro (i32/f32 nei 32 bit bassi)
+    module_slot_t *slot;                // versione del modulo su cui gira il job (riferimento preso da START)
+    uint32_t       job_id;              // riportato in START_OK e RESULT; crescente, quindi anche ordine di arrivo
+    uint32_t       deadline;            // uptime (ms) entro cui il job deve terminare, se has_deadline
+    bool           has_deadline;
+    uint8_t        requested_cls;       // classe chiesta da START: diversa da quella del RUNNER se ripiegata su normal
+} run_request_t;
+
+// Stato di un thread RUNNER (uno per classe). Tutti i campi si toccano con hal_registry_lock()
+// preso, tranne 'stop' che la nativa should_stop legge durante l'esecuzione
+typedef struct {
+    run_request_t  queue[JOB_QUEUE_LEN];   // job accodati da START (non ordinati: l'EDF sceglie al prelievo)
+    uint32_t       queued;
+    bool           busy;                // job (da START o schedulato) in esecuzione
+    volatile bool  stop;                // STOP/UNSCHEDULE del job in esecuzione
+    module_slot_t *running_slot;        // versione su cui sta girando il job corrente
+    uint32_t       running_job;         // job_id in esecuzione (0 = tick di uno schedule)
+    uint32_t       running_sched;       // sched_id in esecuzione (0 = nessuno)
+    char           running_func[64];
+    uint32_t       running_since;       // uptime (ms) di inizio del job corrente
+} runner_t;
+
+static runner_t g_runners[AGENT_PRIO_CLASSES];
+static uint32_t g_next_job_id = 1;
+
+// Durata media (media mobile esponenziale, peso 1/4) dei job per funzione: stima dell'attesa in START_OK
+typedef struct {
+    char     func_name[32];
+    uint32_t avg_us;
+} exec_stat_t;
+
+static exec_stat_t g_exec_stats[EXEC_STATS];
+static uint32_t    g_exec_stats_next = 0;  // voce da sostituire quando la tabella è piena (round robin)
+
+// Esito di una chiamata Wasm eseguita dal RUNNER (job da START o schedulato)
+typedef enum {
+    CALL_OK = 0,
+    CALL_STOPPED,
+    CALL_EXCEPTION,
+    CALL_NO_FUNC,
+    CALL_NO_EXEC_ENV,
+    CALL_NO_MODULE,
+    CALL_BAD_SIG                        // firma cambiata (hot swap) o non supportata dopo START/SCHEDULE
+} call_status_t;
+
+// Risultati tipizzati di una chiamata: kind WAMR (WASM_I32/I64/F32/F64) e bit del valore
+typedef struct {
+    uint8_t  count;
+    uint8_t  kinds[MAX_CALL_RESULTS];
+    uint64_t bits[MAX_CALL_RESULTS];
+} call_values_t;
+
+typedef struct {
+    call_status_t status;
+    call_values_t ret;
+    uint32_t      cycles;
+    uint32_t      exec_us;
+    char          exc[96];              // messaggio dell'eccezione WAMR
+} call_outcome_t;
+
+/*  SCHEDULE: invocazioni periodiche o ritardate eseguite sul device, guidate dai timer della HAL.
+    Alla scadenza il timer (contesto ISR su Zephyr) marca lo schedule come 'due' e sveglia il
+    RUNNER della classe normal; se è occupato il tick viene accorpato al successivo (missed++).
+    I risultati vanno nel ring g_results (FETCH) oppure, con mode=stream, subito sul canale.
+*/
+#define SCHED_RESULTS  16      // ring dei risultati: i più vecchi vengono sovrascritti (dropped)
+
+typedef struct {
+    bool          used;
+    uint32_t      id;                   // sched_id riportato al gateway
+    char          module_id[32];
+    char          func_name[64];
+    uint32_t      argc;
+    uint64_t      argv[MAX_CALL_ARGS];  // come run_request_t, validati con la firma a SCHEDULE
+    uint32_t      period_ms;            // 0 = one-shot
+    uint32_t      max_runs;             // 0 = illimitato
+    uint32_t      runs;                 // solo sotto lock (RUNNER, UNSCHEDULE)
+    atomic_uint   missed;               // tick accorpati perché il runner era occupato (scritto dal timer)
+    bool          stream;               // true: SRESULT subito sul canale, false: nel ring
+    atomic_bool   due;                  // messo dal timer (ISR su Zephyr, dove il mutex del registry
+                                        // non conta), preso dal RUNNER con atomic_exchange
+} schedule_t;
+
+// Esito compatto di un'esecuzione schedulata (il nome della funzione è nello schedule)
+typedef struct {
+    uint32_t sched_id;
+    uint32_t seq;                       // numero dell'esecuzione (1..runs)
+    uint32_t t_ms;                      // uptime al termine
+    uint32_t cycles;
+    uint32_t exec_us;
+    uint8_t  status;                    // call_status_t
+    call_values_t ret;
+} sched_result_t;
+
+static schedule_t     g_schedules[AGENT_MAX_SCHEDULES];   // indice = id del timer HAL
+static uint32_t       g_next_sched_id = 1;
+static sched_result_t g_results[SCHED_RESULTS];
+static uint32_t       g_results_head    = 0;   // prossimo da leggere
+static uint32_t       g_results_count   = 0;
+static uint32_t       g_results_dropped = 0;
+
+
+
+// CRC32 (compatibile zlib)
+static uint32_t crc32_calc(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFFu;   // SEED standard CRC32-zlib (tutti i bit a 1)
+
+    // Per ogni byte del payload
+    for (size_t i = 0; i < len; i++) {
+        uint32_t byte = data[i];    // byte corrente
+        crc ^= byte;  //  XOR iniziale: mescola byte con CRC corrente
+
+        // Processa 8 bit del byte (LSB-first, algoritmo "reversed")
+        for (int j = 0; j < 8; j++) {    // 8 bit del byte
+            uint32_t lsb = crc & 1u;          // LSB corrente (0 o 1)
+            uint32_t mask = -(int32_t)lsb;    // Trick: LSB=1 → mask=0xFFFFFFFF, LSB=0 → mask=0
+            crc = (crc >> 1) ^ (0xEDB88320u & mask);  // Shift destro (simula divisione polinomio) e XOR con polinomio CRC32 SE SOLO LSB era 1
+        }
+    }
+    return ~crc; // NOT finale: inverte tutti i 32 bit (standard zlib)
+}
+
+// funzione nativa chiamata dal Wasm: env.gpio_toggle
+static void
+gpio_toggle_native(wasm_exec_env_t exec_env)
+{
+    (void)exec_env;
+    hal_gpio_toggle();
+}
+
+// nativa env.should_stop: ritorna 1 se STOP richiesto per il job del RUNNER che la chiama
+static int32_t
+should_stop_native(wasm_exec_env_t exec_env)
+{
+    const runner_t *r = (const runner_t *)wasm_runtime_get_user_data(exec_env);
+    return r && r->stop ? 1 : 0;
+}
+
+// tabella delle funzioni native esportate al modulo "env"
+static NativeSymbol native_symbols[] = {
+    { "gpio_toggle",
+      gpio_toggle_native,
+      "()"              // nessun parametro, nessun valore di ritorno
+    },
+    { "should_stop",
+      (void *)should_stop_native,
+      "()i"             // nessun parametro, ritorna i32
+    },
+};
+
+// Utility parsing key=value
+static const char *find_param(const char *line, const char *key)
+{
+    size_t key_len = strlen(key);
+    const char *p = line;
+
+    while ((p = strstr(p, key)) != NULL) {  // strstr(p, key) cerca la prima occorrenza di key a partire da p
+        if (p[key_len] == '=') {   // controlla il carattere dopo key è uguale a '='
+            return p + key_len + 1;  // restituisce tutto dopo il =
+        }
+        p++;
+    }
+    return NULL;
+}
+
+// estrae il valore puro dopo key= fino al primo delimitatore (spazio, \r, \n), copiandolo in modo sicuro nel buffer destinazione
+static void copy_param_value(const char *start, char *dst, size_t dst_len)
+{
+    size_t i = 0;
+    while (start[i] != '\0' &&
+           start[i] != ' '  &&
+           start[i] != '\r' &&
+           start[i] != '\n') {
+        if (i + 1 < dst_len) {
+            // Copia sicura: solo se resta spazio per dst[i] + '\0' finale
+            dst[i] = start[i];
+        }
+        i++;
+    }
+    if (dst_len > 0) {
+        // Terminazione sicura: se i < dst_len: mette '\0' alla posizione i; se i >= dst_len: tronca a dst_len-1 (overflow protetto)
+        dst[i < dst_len ? i : dst_len - 1] = '\0';
+    }
+}
+
+// Parametro numerico key=N (default se assente)
+static uint32_t param_u32(const char *line, const char *key, uint32_t def)
+{
+    char val[16];
+    const char *p = find_param(line, key);
+    if (!p) {
+        return def;
+    }
+    copy_param_value(p, val, sizeof(val));
+    return (uint32_t)strtoul(val, NULL, 10);
+}
+
+
+static const char *valkind_name(wasm_valkind_t kind)
+{
+    switch (kind) {
+    case WASM_I32: return "i32";
+    case WASM_I64: return "i64";
+    case WASM_F32: return "f32";
+    case WASM_F64: return "f64";
+    default:       return "?";   // v128/ref: non passabili come testo
+    }
+}
+
+// Converte il testo di un argomento nel tipo del parametro: interi in base 10 o 0x.. (anche
+// negativi, i32 fino a 0xffffffff), float in notazione decimale. Ritorna false se non valido
+static bool parse_typed_value(const char *s, wasm_valkind_t kind, uint64_t *bits)
+{
+    char *end = NULL;
+    errno = 0;
+
+    switch (kind) {
+    case WASM_I32: {
+        long long v = strtoll(s, &end, 0);
+        if (v < INT32_MIN || v > (long long)UINT32_MAX) {
+            return false;
+        }
+        *bits = (uint32_t)v;
+        break;
+    }
+    case WASM_I64:
+        if (*s == '-') {
+            *bits = (uint64_t)strtoll(s, &end, 0);
+        } else {
+            *bits = (uint64_t)strtoull(s, &end, 0);
+        }
+        break;
+    case WASM_F32: {
+        float f = strtof(s, &end);
+        uint32_t u;
+        memcpy(&u, &f, sizeof(u));
+        *bits = u;
+        break;
+    }
+    case WASM_F64: {
+        double d = strtod(s, &end);
+        memcpy(bits, &d, sizeof(*bits));
+        break;
+    }
+    default:
+        return false;
+    }
+    return end != s && *end == '\0' && errno != ERANGE;
+}
+
+/*  Parsea args="key1=val1,key2=val2,..." (START, SCHEDULE) con la firma dell'export 'fn':
+    il valore i-esimo viene convertito nel tipo del parametro i e salvato in argv[] (i nomi
+    servono solo a chi legge). Ritorna false, con il motivo in err, se il numero di argomenti
+    non coincide con la firma o un valore non è valido per il suo tipo
+*/
+static bool parse_call_args(const char *line, wasm_function_inst_t fn, wasm_module_inst_t inst,
+                            uint64_t *argv, uint32_t *argc, char *err, size_t err_len)
+{
+    char args_buf[128];
+    wasm_valkind_t types[MAX_CALL_ARGS];
+    uint32_t n_params = wasm_func_get_param_count(fn, inst);
+    uint32_t n = 0;
+
+    if (n_params > MAX_CALL_ARGS) {
+        snprintf(err, err_len, "too many params (%lu, max %d)", (unsigned long)n_params, MAX_CALL_ARGS);
+        return false;
+    }
+    wasm_func_get_param_types(fn, inst, types);
+
+    const char *p_args = find_param(line, "args");  // Cerca parametro args= nella riga comando
+    args_buf[0] = '\0';
+    if (p_args && *p_args == '\"') {   //Verifica che args= esista e inizi con "
+        p_args++;      // salta " iniziale
+
+        const char *p_end = strchr(p_args, '\"'); // Trova " finale per estrarre contenuto
+        if (p_end) {
+            size_t len = (size_t)(p_end - p_args);  // lunghezza contenuto ""
+            if (len >= sizeof(args_buf)) {
+                snprintf(err, err_len, "args too long");
+                return false;
+            }
+            memcpy(args_buf, p_args, len);
+            args_buf[len] = '\0';
+        }
+    }
+
+    char *tok = strtok(args_buf, ",");  // primo token
+    while (tok) {
+        char *eq = strchr(tok, '=');  // trova =
+        if (eq) {
+            if (n >= n_params) {
+                n++;   // contato solo per il messaggio d'errore
+            } else if (!parse_typed_value(eq + 1, types[n], &argv[n])) {
+                snprintf(err, err_len, "bad %s value for arg %lu",
+                         valkind_name(types[n]), (unsigned long)(n + 1));
+                return false;
+            } else {
+                n++;
+            }
+        }
+        tok = strtok(NULL, ",");
+    }
+
+    if (n != n_params) {
+        snprintf(err, err_len, "expected %lu args, got %lu",
+                 (unsigned long)n_params, (unsigned long)n);
+        return false;
+    }
+    *argc = n;
+    return true;
+}
+
+// Valore tipizzato come testo: interi con segno, float con le cifre per il round trip
+static int format_value(char *buf, size_t len, wasm_valkind_t kind, uint64_t bits)
+{
+    switch (kind) {
+    case WASM_I32:
+        return snprintf(buf, len, "%ld", (long)(int32_t)(uint32_t)bits);
+    case WASM_I64:
+        return snprintf(buf, len, "%lld", (long long)(int64_t)bits);
+    case WASM_F32: {
+        uint32_t u = (uint32_t)bits;
+        float f;
+        memcpy(&f, &u, sizeof(f));
+        return snprintf(buf, len, "%.9g", (double)f);
+    }
+    case WASM_F64: {
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        return snprintf(buf, len, "%.17g", d);
+    }
+    default:
+        return snprintf(buf, len, "?");
+    }
+}
+
+/*  Aggiunge i risultati a una riga RESULT/SRESULT a partire da buf[n]: un solo risultato i32
+    resta " ret_i32=<u32>" come nelle versioni precedenti del protocollo, altrimenti
+    " ret=<v0>,<v1>,... ret_types=<t0>,<t1>,...". Ritorna la nuova lunghezza (>= len se troncata)
+*/
+static int format_call_values(char *buf, size_t len, int n, const call_values_t *v)
+{
+    if (v->count == 0 || n < 0 || (size_t)n >= len) {
+        return n;
+    }
+    if (v->count == 1 && v->kinds[0] == WASM_I32) {
+        return n + snprintf(buf + n, len - (size_t)n, " ret_i32=%lu", (unsigned long)(uint32_t)v->bits[0]);
+    }
+
+    n += snprintf(buf + n, len - (size_t)n, " ret=");
+    for (uint8_t i = 0; i < v->count && (size_t)n < len; i++) {
+        if (i > 0) {
+            n += snprintf(buf + n, len - (size_t)n, ",");
+        }
+        if ((size_t)n < len) {
+            n += format_value(buf + n, len - (size_t)n, v->kinds[i], v->bits[i]);
+        }
+    }
+    for (uint8_t i = 0; i < v->count && (size_t)n < len; i++) {
+        n += snprintf(buf + n, len - (size_t)n, "%s%s", i == 0 ? " ret_types=" : ",",
+                      valkind_name(v->kinds[i]));
+    }
+    return n;
+}
+
+
+// Registry: scarica il modulo (istanza, modulo parsato, buffer binario)
+static void registry_unload(module_slot_t *slot)
+{
+    if (slot->inst) {
+        wasm_runtime_deinstantiate(slot->inst);  // distrugge istanza (memoria, stack)
+        slot->inst = NULL;
+    }
+    for (int c = 0; c < AGENT_PRIO_CLASSES; c++) {
+        if (slot->class_inst[c]) {
+            wasm_runtime_deinstantiate(slot->class_inst[c]);
+            slot->class_inst[c] = NULL;
+        }
+    }
+    if (slot->module) {
+        wasm_runtime_unload(slot->module);       // libera modulo parsato
+        slot->module = NULL;
+    }
+    free(slot->buf);                             // libera buffer binario
+    slot->buf     = NULL;
+    slot->size    = 0;
+    slot->version = 0;
+    slot->refs    = 0;
+    slot->staged  = false;
+    slot->is_aot  = false;
+    slot->loaded  = false;
+}
+
+// Slot per una nuova versione, NULL se sono tutti occupati (versione attiva più versioni in
+// ritiro con job in coda o in corso): LOAD risponde BUSY. La versione attiva non viene mai
+// riciclata qui, perché un LOAD che poi fallisce (CRC, timeout, LOAD_FAIL) lascerebbe il
+// device senza modulo; viene scaricata solo da registry_activate() a nuova versione pronta
+static module_slot_t *registry_alloc_slot(void)
+{
+    module_slot_t *slot = NULL;
+
+    hal_registry_lock();
+    for (int i = 0; i < MODULE_VERSIONS; i++) {
+        if (!g_slots[i].loaded && !g_slots[i].buf) {
+            slot = &g_slots[i];
+            break;
+        }
+    }
+    hal_registry_unlock();
+
+    return slot;
+}
+
+// C'è un job in corso su una versione diversa da 'slot'? (la sua istanza occupa ancora RAM)
+static bool registry_other_in_use(const module_slot_t *slot)
+{
+    bool in_use = false;
+
+    hal_registry_lock();
+    for (int i = 0; i < MODULE_VERSIONS; i++) {
+        if (&g_slots[i] != slot && g_slots[i].refs > 0) {
+            in_use = true;
+        }
+    }
+    hal_registry_unlock();
+
+    return in_use;
+}
+
+// LOAD su una versione attiva che nessun job usa (nessuna versione ha job in coda o in corso):
+// ne libera le istanze prima di istanziare la nuova, perché il pool WAMR (64 KB sulla F446)
+// ne contiene una sola. Ritorna la versione sospesa da passare a registry_resume() se il LOAD
+// fallisce, NULL se non c'era nulla da liberare o se un job la usa (la nuova resta staged).
+// Finché è sospesa i START ricevono BUSY "module staged", come per una versione staged
+static module_slot_t *registry_suspend_idle(void)
+{
+    module_slot_t *old = NULL;
+
+    hal_registry_lock();
+    bool in_use = false;
+    for (int i = 0; i < MODULE_VERSIONS; i++) {
+        if (g_slots[i].refs > 0) {
+            in_use = true;
+        }
+    }
+    if (g_active && g_active->inst && !in_use) {
+        old = g_active;
+        wasm_runtime_deinstantiate(old->inst);
+        old->inst = NULL;
+        for (int c = 0; c < AGENT_PRIO_CLASSES; c++) {
+            if (old->class_inst[c]) {
+                wasm_runtime_deinstantiate(old->class_inst[c]);
+                old->class_inst[c] = NULL;
+            }
+        }
+    }
+    hal_registry_unlock();
+
+    return old;
+}
+
+// LOAD fallito dopo registry_suspend_idle(): la versione precedente torna eseguibile. Nessun
+// job può usarla nel frattempo (senza istanza START non prende riferimenti), quindi si istanzia
+// fuori dal lock; se non c'è più RAM nemmeno per lei il device resta senza modulo (NO_MODULE)
+static void registry_resume(module_slot_t *old)
+{
+    if (!old) {
+        return;
+    }
+
+    char error_buf[128];
+    wasm_module_inst_t inst = wasm_runtime_instantiate(old->module,
+                                                       CONFIG_APP_STACK_SIZE,
+                                                       CONFIG_APP_HEAP_SIZE,
+                                                       error_buf, sizeof(error_buf));
+    hal_registry_lock();
+    if (inst) {
+        old->inst = inst;
+    } else if (g_active == old) {
+        g_active = NULL;
+        registry_unload(old);
+    }
+    hal_registry_unlock();
+}
+
+// Versione in ritiro (caricata ma non più attiva), 0 = nessuna. Da chiamare con il lock preso
+static uint32_t registry_retiring_version(void)
+{
+    for (int i = 0; i < MODULE_VERSIONS; i++) {
+        if (g_slots[i].loaded && &g_slots[i] != g_active) {
+            return g_slots[i].version;
+        }
+    }
+    return 0;
+}
+
+// Rende attiva la nuova versione; la precedente viene scaricata subito se nessun job la usa,
+// altrimenti resta in ritiro fino a registry_release(). Ritorna la versione in ritiro (0 = nessuna)
+static uint32_t registry_activate(module_slot_t *slot)
+{
+    hal_registry_lock();
+    module_slot_t *old = g_active;
+    g_active = slot;
+    if (old && old != slot && old->refs == 0) {
+        registry_unload(old);
+    }
+    uint32_t retiring = registry_retiring_version();
+    hal_registry_unlock();
+
+    return retiring;
+}
+
+// Fine job (o job tolto dalla coda): rilascia il riferimento preso da START e scarica la
+// versione se è stata sostituita nel frattempo
+static void registry_release(module_slot_t *slot)
+{
+    hal_registry_lock();
+    if (slot->refs > 0) {
+        slot->refs--;
+    }
+    if (slot != g_active && slot->refs == 0 && slot->loaded) {
+        registry_unload(slot);
+    }
+    hal_registry_unlock();
+}
+
+// Istanzia la versione attiva se il LOAD l'ha lasciata staged (chiamata dal RUNNER a job concluso).
+// L'istanziazione (allocazione di heap e stack WASM) avviene fuori dal lock, per non fermare COMM
+// e gli altri RUNNER: sotto lock si prenota lo slot (staged=false più un riferimento, così un LOAD
+// concorrente non lo scarica) e poi si pubblica l'istanza
+static void registry_instantiate_staged(void)
+{
+    hal_registry_lock();
+    module_slot_t *slot = g_active;
+    bool claimed = slot && slot->staged;
+    if (claimed) {
+        slot->staged = false;   // gli altri RUNNER non ci riprovano in parallelo
+        slot->refs++;
+    }
+    hal_registry_unlock();
+
+    if (!claimed) {
+        return;
+    }
+
+    char error_buf[128];
+    wasm_module_inst_t inst = wasm_runtime_instantiate(slot->module,
+                                                       CONFIG_APP_STACK_SIZE,
+                                                       CONFIG_APP_HEAP_SIZE,
+                                                       error_buf, sizeof(error_buf));
+    char out_buf[192];
+    out_buf[0] = '\0';
+
+    hal_registry_lock();
+    bool other_in_use = false;
+    for (int i = 0; i < MODULE_VERSIONS; i++) {
+        if (&g_slots[i] != slot && g_slots[i].refs > 0) {
+            other_in_use = true;
+        }
+    }
+    if (inst) {
+        slot->inst = inst;      // se nel frattempo un LOAD l'ha sostituita, registry_release() la scarica
+    } else if (other_in_use) {
+        // un altro RUNNER tiene ancora in RAM una versione in ritiro: si riprova a fine del suo job
+        slot->staged = true;
+    } else if (slot == g_active) {
+        // nessuno sta aspettando una risposta: riga asincrona, i START successivi ricevono NO_MODULE
+        snprintf(out_buf, sizeof(out_buf),
+                 "LOAD_ERR code=INSTANTIATE_FAIL module_id=%s version=%lu msg=\"%s\"\n",
+                 slot->module_id, (unsigned long)slot->version, error_buf);
+        g_active = NULL;
+    }
+    hal_registry_unlock();
+
+    if (out_buf[0]) {
+        hal_write_str(out_buf);
+    }
+    registry_release(slot);     // scarica lo slot se non è (più) la versione attiva
+}
+
+// Istanza su cui gira la classe 'cls': normal usa quella creata da LOAD, high e low una propria
+static wasm_module_inst_t slot_instance(const module_slot_t *slot, int cls)
+{
+    return cls == PRIO_NORMAL ? slot->inst : slot->class_inst[cls];
+}
+
+// START high/low: crea (al primo uso) l'istanza della classe sulla versione 'slot'.
+// Se la RAM non basta il job ripiega sulla classe normal, che usa l'istanza di LOAD: sulla F446
+// succede con ogni modulo con memoria lineare, perché il pool WAMR da 64 KB ne contiene una sola.
+// Il chiamante (COMM, unico a creare istanze di classe) tiene un riferimento su 'slot', quindi
+// l'istanziazione avviene fuori dal lock come in registry_instantiate_staged()
+static int registry_class_instance(module_slot_t *slot, int cls)
+{
+    if (cls == PRIO_NORMAL) {
+        return cls;
+    }
+
+    hal_registry_lock();
+    bool have = slot->class_inst[cls] != NULL;
+    hal_registry_unlock();
+    if (have) {
+        return cls;
+    }
+
+    char error_buf[128];
+    wasm_module_inst_t inst = wasm_runtime_instantiate(slot->module,
+                                                       CONFIG_APP_STACK_SIZE,
+                                                       CONFIG_APP_HEAP_SIZE,
+                                                       error_buf, sizeof(error_buf));
+    if (!inst) {
+        return PRIO_NORMAL;
+    }
+
+    hal_registry_lock();
+    slot->class_inst[cls] = inst;
+    hal_registry_unlock();
+
+    return cls;
+}
+
+// Durata media stimata di func in µs (0 = mai eseguita). Da chiamare con il lock preso
+static uint32_t exec_estimate_us(const char *func_name)
+{
+    for (int i = 0; i < EXEC_STATS; i++) {
+        if (g_exec_stats[i].func_name[0] &&
+            strncmp(g_exec_stats[i].func_name, func_name, sizeof(g_exec_stats[i].func_name) - 1) == 0) {
+            return g_exec_stats[i].avg_us;
+        }
+    }
+    return 0;
+}
+
+// Aggiorna la durata media di func con un nuovo campione
+static void exec_stats_update(const char *func_name, uint32_t exec_us)
+{
+    hal_registry_lock();
+    exec_stat_t *st = NULL;
+    for (int i = 0; i < EXEC_STATS && !st; i++) {
+        if (g_exec_stats[i].func_name[0] &&
+            strncmp(g_exec_stats[i].func_name, func_name, sizeof(g_exec_stats[i].func_name) - 1) == 0) {
+            st = &g_exec_stats[i];
+        }
+    }
+    if (st) {
+        st->avg_us = st->avg_us - st->avg_us / 4u + exec_us / 4u;
+    } else {
+        st = &g_exec_stats[g_exec_stats_next];
+        g_exec_stats_next = (g_exec_stats_next + 1u) % EXEC_STATS;
+        strncpy(st->func_name, func_name, sizeof(st->func_name) - 1);
+        st->func_name[sizeof(st->func_name) - 1] = '\0';
+        st->avg_us = exec_us;       // primo campione
+    }
+    hal_registry_unlock();
+}
+
+// Ordine EDF: deadline più vicina prima, i job senza deadline in fondo, a parità l'arrivo
+static bool job_earlier(const run_request_t *a, const run_request_t *b)
+{
+    if (a->has_deadline != b->has_deadline) {
+        return a->has_deadline;
+    }
+    if (a->has_deadline && a->deadline != b->deadline) {
+        return (int32_t)(a->deadline - b->deadline) < 0;    // confronto robusto all'overflow dell'uptime
+    }
+    return (int32_t)(a->job_id - b->job_id) < 0;
+}
+
+// Attesa stimata (ms) prima che 'req' parta nella sua classe: resto del job in esecuzione più la
+// durata media dei job in coda che l'EDF servirebbe prima. Non conta le interruzioni da parte
+// delle classi più urgenti. In *ahead i job davanti. Da chiamare con il lock preso
+static uint32_t runner_expected_wait_ms(int cls, const run_request_t *req, uint32_t now, uint32_t *ahead)
+{
+    const runner_t *r = &g_runners[cls];
+    uint32_t wait_ms = 0;
+
+    *ahead = 0;
+    if (r->busy) {
+        uint32_t est_ms     = exec_estimate_us(r->running_func) / 1000u;
+        uint32_t elapsed_ms = now - r->running_since;
+        wait_ms += est_ms > elapsed_ms ? est_ms - elapsed_ms : 0;
+        (*ahead)++;
+    }
+    for (uint32_t i = 0; i < r->queued; i++) {
+        if (job_earlier(&r->queue[i], req)) {
+            wait_ms += exec_estimate_us(r->queue[i].func_name) / 1000u;
+            (*ahead)++;
+        }
+    }
+    return wait_ms;
+}
+
+// Tier riportato in LOAD_OK/STATUS/RESULT (il bytecode gira sul fast interpreter se abilitato in CMake)
+static const char *module_tier(const module_slot_t *slot)
+{
+    return slot->is_aot ? "aot" : "interp";
+}
+
+
+// Gestione comando LOAD: parsa parametri, alloca buffer, riceve payload binario, verifica CRC, carica in WAMR
+/* Formato:
+      LOAD module_id=<id> size=12345 crc32=1a2b3c4d
+   Poi arrivano 'size' byte di payload
+*/
+static void handle_load_cmd(const char *line)
+{
+    // Buffer temporanei per estrarre size e crc32 dalla riga comando
+    char size_str[16];
+    char crc_str[16];
+
+    // find_param cerca "key=" nella stringa line e ritorna puntatore al valore
+    const char *p_size = find_param(line, "size");      // es: "12345"
+    const char *p_crc  = find_param(line, "crc32");     // es: "ABCD1234"
+    char out_buf[160];                                  // buffer per messaggi di risposta
+
+    // Validazione parametri obbligatori
+    if (!p_size) {
+        hal_write_str("LOAD_ERR code=BAD_PARAMS msg=\"missing size\"\n");
+        return;
+    }
+    if (!p_crc) {
+        hal_write_str("LOAD_ERR code=BAD_PARAMS msg=\"missing crc32\"\n");
+        return;
+    }
+
+    // Estrae i valori puri (senza =) nei buffer locali
+    copy_param_value(p_size, size_str, sizeof(size_str));  // size_str = "12345"
+    copy_param_value(p_crc,  crc_str,  sizeof(crc_str));   // crc_str  = "ABCD1234"
+
+    // Converte size in intero, valida > 0
+    uint32_t size = (uint32_t)atoi(size_str);
+    if (size == 0) {
+        hal_write_str("LOAD_ERR code=BAD_PARAMS msg=\"size=0\"\n");
+        return;
+    }
+
+    // Converte CRC esadecimale in intero
+    uint32_t crc_expected = (uint32_t)strtoul(crc_str, NULL, 16);  // 0xABCD1234
+
+    // Slot per la nuova versione: quella attiva resta in servizio finché la nuova non è pronta
+    module_slot_t *slot = registry_alloc_slot();
+    if (!slot) {
+        // tutte le versioni sono in uso da job in coda o in corso: si riprova quando ne finisce uno
+        hal_write_str("LOAD_ERR code=BUSY msg=\"no free module slot\"\n");
+        return;
+    }
+
+    // Alloca buffer RAM per il nuovo modulo
+    slot->buf = (uint8_t *)malloc(size);
+    if (!slot->buf) {
+        hal_write_str("LOAD_ERR code=NO_MEM\n");
+        return;
+    }
+    slot->size = size;  // salva dimensione per uso successivo
+
+    // prepara la HAL a ricevere il payload binario (prima di LOAD_READY)
+    hal_binary_arm(slot->buf, slot->size);
+
+    // Avvisa gateway: "pronto, manda il payload binario"
+    snprintf(out_buf, sizeof(out_buf),
+             "LOAD_READY size=%lu crc32=%s\n",
+             (unsigned long)slot->size, crc_str);
+    hal_write_str(out_buf);
+
+    // BLOCCA: aspetta che arrivi tutto il payload (max 5s)
+    if (hal_binary_wait(LOAD_PAYLOAD_TIMEOUT_MS) != 0) {
+        // Timeout: non è arrivato tutto
+        hal_write_str("LOAD_ERR code=TIMEOUT msg=\"binary payload not received\"\n");
+        registry_unload(slot);
+        return;
+    }
+
+    // Verifica integrità: calcola CRC32 del buffer ricevuto
+    uint32_t crc_calc = crc32_calc(slot->buf, slot->size);
+    if (crc_calc != crc_expected) {
+        snprintf(out_buf, sizeof(out_buf),
+                 "LOAD_ERR code=BAD_CRC msg=\"expected=%08lx got=%08lx\"\n",
+                 (unsigned long)crc_expected,
+                 (unsigned long)crc_calc);
+        hal_write_str(out_buf);
+        registry_unload(slot);
+        return;
+    }
+
+    // Carica modulo in WAMR: parsing del binario Wasm/AOT
+    char error_buf[128];
+    slot->module = wasm_runtime_load(slot->buf, slot->size,
+                                     error_buf, sizeof(error_buf));
+    if (!slot->module) {
+        snprintf(out_buf, sizeof(out_buf),
+                 "LOAD_ERR code=LOAD_FAIL msg=\"%s\"\n", error_buf);
+        hal_write_str(out_buf);
+        registry_unload(slot);
+        return;
+    }
+
+    // Crea istanza eseguibile: alloca memoria/stack/heap per il modulo. Se la versione attiva
+    // è ferma se ne libera prima l'istanza (il pool WAMR non ne tiene due), come il LOAD che
+    // scaricava il modulo precedente; se invece ha job in coda o in corso la nuova resta staged
+    module_slot_t *suspended = registry_suspend_idle();
+    slot->inst = wasm_runtime_instantiate(slot->module,
+                                          CONFIG_APP_STACK_SIZE,
+                                          CONFIG_APP_HEAP_SIZE,
+                                          error_buf, sizeof(error_buf));
+    if (!slot->inst) {
+        if (registry_other_in_use(slot)) {
+            // la vecchia istanza (job in corso) occupa ancora la RAM: si istanzia a fine job
+            slot->staged = true;
+        } else {
+            snprintf(out_buf, sizeof(out_buf),
+                     "LOAD_ERR code=INSTANTIATE_FAIL msg=\"%s\"\n", error_buf);
+            hal_write_str(out_buf);
+            registry_unload(slot);       // cleanup modulo parsato e buffer
+            registry_resume(suspended);  // la versione precedente torna in servizio
+            return;
+        }
+    }
+
+    // Salva module_id dal comando LOAD per uso successivo (STATUS, ecc.)
+    const char *p_mod = find_param(line, "module_id");
+    if (p_mod) {
+        copy_param_value(p_mod, slot->module_id, sizeof(slot->module_id));
+    } else {
+        // se manca module_id, azzera l'ID corrente
+        slot->module_id[0] = '\0';
+    }
+
+    // Modulo caricato con successo; tier dal magic number: "\0aot" per i file prodotti da wamrc, "\0asm" per il bytecode
+    slot->is_aot  = slot->size >= 4 && memcmp(slot->buf, "\0aot", 4) == 0;
+    slot->version = g_next_version++;
+    slot->loaded  = true;
+
+    // swap atomico: da qui i nuovi START usano questa versione
+    uint32_t retiring = registry_activate(slot);
+
+    int n = snprintf(out_buf, sizeof(out_buf), "LOAD_OK tier=%s version=%lu",
+                     module_tier(slot), (unsigned long)slot->version);
+    if (retiring) {
+        n += snprintf(out_buf + n, sizeof(out_buf) - (size_t)n, " retiring=%lu",
+                      (unsigned long)retiring);
+    }
+    snprintf(out_buf + n, sizeof(out_buf) - (size_t)n, "%s\n",
+             slot->staged ? " staged=1" : "");
+    hal_write_str(out_buf);  // conferma al gateway
+}
+
+
+// Gestione comando START (accoda il job al RUNNER della sua classe)
+/* Esempi:
+      START module_id=toggle_forever func=toggle_forever prio=low
+      START module_id=toggle_n func=toggle_n args="n=100"
+      START module_id=math_ops func=add args="a=200,b=26" prio=high deadline_ms=50
+   prio=high|normal|low (default normal), deadline_ms = tempo massimo per terminare, da ora.
+   Risposte:
+      START_OK job_id=<n> prio=<classe> ahead=<job davanti> expected_wait_ms=<stima>
+      RESULT status=BUSY ...                  coda della classe piena (con la stima dell'attesa)
+      RESULT status=REJECTED reason=DEADLINE  la deadline non è rispettabile con la coda attuale
+*/
+static void handle_start_cmd(const char *line)
+{
+    char func_name[64];
+    char module_id_buf[32];
+    char prio_buf[16] = "normal";
+    char out[192];
+    char err[64];
+    uint64_t argv[MAX_CALL_ARGS];
+    uint32_t argc = 0;
+
+    // legge module_id=...
+    const char *p_mod = find_param(line, "module_id");
+    if (!p_mod) {
+        hal_write_str("RESULT status=BAD_PARAMS msg=\"missing module_id\"\n");
+        return;
+    }
+    copy_param_value(p_mod, module_id_buf, sizeof(module_id_buf));
+
+    // func=<nome_funzione>
+    const char *p_func = find_param(line, "func");
+    if (!p_func) {
+        hal_write_str("RESULT status=BAD_PARAMS msg=\"missing func\"\n");
+        return;
+    }
+    copy_param_value(p_func, func_name, sizeof(func_name));
+
+    // prio=<classe>
+    const char *p_prio = find_param(line, "prio");
+    if (p_prio) {
+        copy_param_value(p_prio, prio_buf, sizeof(prio_buf));
+    }
+    int cls = -1;
+    for (int c = 0; c < AGENT_PRIO_CLASSES; c++) {
+        if (strcmp(prio_buf, g_prio_names[c]) == 0) {
+            cls = c;
+        }
+    }
+    if (cls < 0) {
+        hal_write_str("RESULT status=BAD_PARAMS msg=\"prio must be high, normal or low\"\n");
+        return;
+    }
+    uint32_t deadline_ms = param_u32(line, "deadline_ms", 0);
+
+    // versione attiva e riferimento presi insieme sotto lock, come fa il RUNNER: da qui un LOAD
+    // o registry_instantiate_staged() non possono scaricare lo slot mentre se ne usa l'istanza.
+    // Il riferimento passa al job se viene accodato, altrimenti si rilascia a ogni uscita
+    hal_registry_lock();
+    module_slot_t *slot = g_active;
+    bool mod_ok = slot && strcmp(module_id_buf, slot->module_id) == 0;
+    bool staged = mod_ok && !slot->inst;   // diventa eseguibile quando il job in ritiro libera la RAM
+    if (mod_ok && !staged) {
+        slot->refs++;
+    }
+    hal_registry_unlock();
+
+    if (!slot) {
+        hal_write_str("RESULT status=NO_MODULE\n");
+        return;
+    }
+    if (!mod_ok) {
+        hal_write_str("RESULT status=NO_MODULE msg=\"module_id mismatch\"\n");
+        return;
+    }
+    if (staged) {
+        hal_write_str("RESULT status=BUSY msg=\"module staged\"\n");
+        return;
+    }
+
+    // verifica subito che la funzione esista
+    wasm_function_inst_t fn =
+        wasm_runtime_lookup_function(slot->inst, func_name);
+    if (!fn) {
+        snprintf(out, sizeof(out),
+                 "RESULT status=NO_FUNC name=%s\n", func_name);
+        hal_write_str(out);
+        registry_release(slot);
+        return;
+    }
+
+    // Parsea args="key1=val1,key2=val2,..." → argv[] nei tipi dei parametri della funzione
+    if (!parse_call_args(line, fn, slot->inst, argv, &argc, err, sizeof(err))) {
+        snprintf(out, sizeof(out),
+                 "RESULT status=BAD_PARAMS func=%s msg=\"%s\"\n", func_name, err);
+        hal_write_str(out);
+        registry_release(slot);
+        return;
+    }
+
+    // high/low girano su un'istanza propria: senza RAM per crearla il job va in coda normal,
+    // e START_OK/RESULT riportano prio=normal con requested=<classe chiesta>
+    int requested = cls;
+    cls = registry_class_instance(slot, cls);
+
+    // Prepara richiesta per il RUNNER
+    run_request_t req;
+    memset(&req, 0, sizeof(req));  // Pulisce struttura richiesta (zero tutti i campi)
+    strncpy(req.func_name, func_name, sizeof(req.func_name) - 1);
+    req.argc = argc;
+    for (uint32_t i = 0; i < argc && i < MAX_CALL_ARGS; i++) {
+        req.argv[i] = argv[i];
+    }
+    req.slot = slot;
+    req.requested_cls = (uint8_t)requested;
+
+    // admission control sulla coda della classe, sotto lock (i RUNNER prelevano in parallelo)
+    hal_registry_lock();
+    runner_t *r   = &g_runners[cls];
+    uint32_t  now = hal_uptime_ms();
+    req.job_id       = g_next_job_id++;
+    req.has_deadline = deadline_ms > 0;
+    req.deadline     = now + deadline_ms;
+
+    uint32_t ahead;
+    uint32_t wait_ms = runner_expected_wait_ms(cls, &req, now, &ahead);
+    uint32_t exec_ms = exec_estimate_us(func_name) / 1000u;
+
+    if (r->queued >= JOB_QUEUE_LEN) {
+        hal_registry_unlock();
+        snprintf(out, sizeof(out),
+                 "RESULT status=BUSY prio=%s queued=%lu expected_wait_ms=%lu\n",
+                 g_prio_names[cls], (unsigned long)r->queued, (unsigned long)wait_ms);
+        hal_write_str(out);
+        registry_release(slot);
+        return;
+    }
+    if (req.has_deadline && wait_ms + exec_ms > deadline_ms) {
+        hal_registry_unlock();
+        snprintf(out, sizeof(out),
+                 "RESULT status=REJECTED reason=DEADLINE prio=%s expected_wait_ms=%lu est_exec_ms=%lu\n",
+                 g_prio_names[cls], (unsigned long)wait_ms, (unsigned long)exec_ms);
+        hal_write_str(out);
+        registry_release(slot);
+        return;
+    }
+
+    r->queue[r->queued++] = req;        // il riferimento preso sopra tiene viva la versione per il job
+
+    // conferma di START ancora sotto lock: il RUNNER (su POSIX anche in parallelo) non può
+    // prelevare il job, e quindi inviare il RESULT di una funzione breve, prima di START_OK
+    snprintf(out, sizeof(out),
+             "START_OK job_id=%lu prio=%s%s%s ahead=%lu expected_wait_ms=%lu\n",
+             (unsigned long)req.job_id, g_prio_names[cls],
+             requested != cls ? " requested=" : "", requested != cls ? g_prio_names[requested] : "",
+             (unsigned long)ahead, (unsigned long)wait_ms);
+    hal_write_str(out);
+    hal_registry_unlock();
+
+    // sveglia il runner della classe
+    hal_runner_notify(cls);
+}
+
+
+
+// Gestione comando STOP
+/* Formato:
+      STOP module_id=<id> [job_id=<n>]
+   Ferma i job del modulo in esecuzione (solo job_id, se indicato) e toglie dalle code quelli
+   non ancora partiti, inviando per ciascuno RESULT status=STOPPED
+*/
+static void handle_stop_cmd(const char *line)
+{
+    char module_id_buf[32];
+    char out[160];
+    run_request_t dequeued[AGENT_PRIO_CLASSES * JOB_QUEUE_LEN];
+    uint32_t n_dequeued = 0;
+    uint32_t n_running  = 0;
+    bool     any_busy   = false;
+
+    const char *p_mod = find_param(line, "module_id");
+    if (p_mod) {
+        copy_param_value(p_mod, module_id_buf, sizeof(module_id_buf));
+    }
+    uint32_t job_id = param_u32(line, "job_id", 0);
+
+    // confronto sul module_id e non sulla versione: anche i job sulla versione in ritiro
+    hal_registry_lock();
+    for (int c = 0; c < AGENT_PRIO_CLASSES; c++) {
+        runner_t *r = &g_runners[c];
+        any_busy = any_busy || r->busy;
+        if (!p_mod) {
+            continue;
+        }
+        if (r->busy && r->running_slot &&
+            strcmp(module_id_buf, r->running_slot->module_id) == 0 &&
+            (!job_id || r->running_job == job_id)) {
+            r->stop = true;
+            n_running++;
+        }
+        for (uint32_t i = 0; i < r->queued; ) {
+            run_request_t *q = &r->queue[i];
+            if (strcmp(module_id_buf, q->slot->module_id) == 0 && (!job_id || q->job_id == job_id)) {
+                dequeued[n_dequeued++] = *q;
+                *q = r->queue[--r->queued];
+            } else {
+                i++;
+            }
+        }
+    }
+    hal_registry_unlock();
+
+    if (n_running) {
+        hal_write_str("STOP_OK status=PENDING\n");
+    } else if (n_dequeued) {
+        snprintf(out, sizeof(out), "STOP_OK status=DEQUEUED count=%lu\n", (unsigned long)n_dequeued);
+        hal_write_str(out);
+    } else {
+        hal_write_str(any_busy ? "STOP_OK status=NO_JOB\n" : "STOP_OK status=IDLE\n");
+    }
+
+    // job tolti dalla coda: mai partiti, rilasciano subito la versione
+    for (uint32_t i = 0; i < n_dequeued; i++) {
+        snprintf(out, sizeof(out), "RESULT status=STOPPED func=%s job_id=%lu queued=1\n",
+                 dequeued[i].func_name, (unsigned long)dequeued[i].job_id);
+        hal_write_str(out);
+        registry_release(dequeued[i].slot);
+    }
+}
+
+
+// Gestione comando STATUS
+static void handle_status_cmd(const char *line)
+{
+    (void)line;
+    char out_buf[256];
+    int n;
+
+    // snapshot sotto lock: il RUNNER può scaricare la versione in ritiro in qualunque momento
+    hal_registry_lock();
+    bool     busy[AGENT_PRIO_CLASSES];
+    uint32_t queued_total = 0;
+    bool     any_busy     = false;
+    for (int c = 0; c < AGENT_PRIO_CLASSES; c++) {
+        busy[c]       = g_runners[c].busy;
+        any_busy      = any_busy || busy[c];
+        queued_total += g_runners[c].queued;
+    }
+    const char *runner = any_busy ? "RUNNING" : "IDLE";
+    uint32_t retiring = registry_retiring_version();
+    if (!g_active) {
+        n = snprintf(out_buf, sizeof(out_buf),
+                     "STATUS_OK modules=\"none\" runner=%s", runner);
+    } else {
+        n = snprintf(out_buf, sizeof(out_buf),
+                     "STATUS_OK modules=\"wasm_module(loaded)\" module_id=%s runner=%s tier=%s version=%lu",
+                     g_active->module_id, runner, module_tier(g_active),
+                     (unsigned long)g_active->version);
+        if (retiring) {
+            n += snprintf(out_buf + n, sizeof(out_buf) - (size_t)n, " retiring=%lu",
+                          (unsigned long)retiring);
+        }
+        if (g_active->staged) {
+            n += snprintf(out_buf + n, sizeof(out_buf) - (size_t)n, " staged=1");
+        }
+    }
+
+    // schedule attivi e risultati in attesa di FETCH
+    uint32_t n_sched = 0;
+    for (int i = 0; i < AGENT_MAX_SCHEDULES; i++) {
+        if (g_schedules[i].used) {
+            n_sched++;
+        }
+    }
+    if (n_sched || g_results_count) {
+        n += snprintf(out_buf + n, sizeof(out_buf) - (size_t)n, " schedules=%lu results=%lu",
+                      (unsigned long)n_sched, (unsigned long)g_results_count);
+    }
+
+    // classi con un job in esecuzione e job in coda per classe (high,normal,low)
+    if (any_busy || queued_total) {
+        n += snprintf(out_buf + n, sizeof(out_buf) - (size_t)n, " busy=%s%s%s%s queued=%lu,%lu,%lu",
+                      busy[PRIO_HIGH] ? "H" : "", busy[PRIO_NORMAL] ? "N" : "", busy[PRIO_LOW] ? "L" : "",
+                      any_busy ? "" : "-",
+                      (unsigned long)g_runners[PRIO_HIGH].queued,
+                      (unsigned long)g_runners[PRIO_NORMAL].queued,
+                      (unsigned long)g_runners[PRIO_LOW].queued);
+    }
+    snprintf(out_buf + n, sizeof(out_buf) - (size_t)n, "\n");
+    hal_registry_unlock();
+
+    hal_write_str(out_buf);
+}
+
+static const char *call_status_name(call_status_t status)
+{
+    switch (status) {
+    case CALL_OK:          return "OK";
+    case CALL_STOPPED:     return "STOPPED";
+    case CALL_EXCEPTION:   return "EXCEPTION";
+    case CALL_NO_FUNC:     return "NO_FUNC";
+    case CALL_NO_EXEC_ENV: return "NO_EXEC_ENV";
+    case CALL_BAD_SIG:     return "BAD_SIG";
+    default:               return "NO_MODULE";
+    }
+}
+
+// Riga SRESULT (stessa forma per FETCH e per mode=stream)
+static void format_sched_result(const sched_result_t *r, char *buf, size_t len)
+{
+    int n = snprintf(buf, len, "SRESULT sched_id=%lu seq=%lu t_ms=%lu status=%s",
+                     (unsigned long)r->sched_id, (unsigned long)r->seq,
+                     (unsigned long)r->t_ms, call_status_name((call_status_t)r->status));
+    n = format_call_values(buf, len, n, &r->ret);
+    if (n > 0 && (size_t)n < len) {
+        n += snprintf(buf + n, len - (size_t)n, " cycles=%lu exec_us=%lu\n",
+                      (unsigned long)r->cycles, (unsigned long)r->exec_us);
+    }
+    if (n < 0 || (size_t)n >= len) {   // riga troncata: termina comunque con \n
+        buf[len - 2] = '\n';
+        buf[len - 1] = '\0';
+    }
+}
+
+// Accoda un risultato nel ring; se pieno sovrascrive il più vecchio. Da chiamare con il lock preso
+static void results_push(const sched_result_t *r)
+{
+    if (g_results_count == SCHED_RESULTS) {
+        g_results_head = (g_results_head + 1) % SCHED_RESULTS;
+        g_results_count--;
+        g_results_dropped++;
+    }
+    g_results[(g_results_head + g_results_count) % SCHED_RESULTS] = *r;
+    g_results_count++;
+}
+
+
+// Gestione comando SCHEDULE: registra un'invocazione periodica (period_ms) o one-shot (solo delay_ms)
+/* Esempi:
+      SCHEDULE module_id=sensor func=poll period_ms=100
+      SCHEDULE module_id=sensor func=poll period_ms=100 max_runs=50 mode=stream
+      SCHEDULE module_id=math_ops func=add args="a=1,b=2" delay_ms=5000
+   Risposta: SCHEDULE_OK sched_id=<n>
+*/
+static void handle_schedule_cmd(const char *line)
+{
+    char module_id_buf[32];
+    char func_name[64];
+    char mode[16] = "batch";
+    char out_buf[128];
+    char err[64];
+
+    const char *p_mod  = find_param(line, "module_id");
+    const char *p_func = find_param(line, "func");
+    if (!p_mod || !p_func) {
+        hal_write_str("SCHEDULE_ERR code=BAD_PARAMS msg=\"missing module_id or func\"\n");
+        return;
+    }
+    copy_param_value(p_mod,  module_id_buf, sizeof(module_id_buf));
+    copy_param_value(p_func, func_name,     sizeof(func_name));
+
+    uint32_t period_ms = param_u32(line, "period_ms", 0);
+    uint32_t delay_ms  = param_u32(line, "delay_ms", period_ms);   // primo tick dopo un periodo
+    uint32_t max_runs  = param_u32(line, "max_runs", 0);
+    if (period_ms == 0 && delay_ms == 0) {
+        hal_write_str("SCHEDULE_ERR code=BAD_PARAMS msg=\"missing period_ms or delay_ms\"\n");
+        return;
+    }
+    if (period_ms == 0) {
+        max_runs = 1;   // one-shot
+    }
+
+    const char *p_mode = find_param(line, "mode");
+    if (p_mode) {
+        copy_param_value(p_mode, mode, sizeof(mode));
+    }
+    if (strcmp(mode, "batch") != 0 && strcmp(mode, "stream") != 0) {
+        hal_write_str("SCHEDULE_ERR code=BAD_PARAMS msg=\"mode must be batch or stream\"\n");
+        return;
+    }
+
+    uint64_t argv[MAX_CALL_ARGS];
+    uint32_t argc = 0;
+
+    // il modulo deve essere già caricato (il tick userà la versione attiva in quel momento);
+    // gli argomenti si convertono una volta qui, con la firma della funzione
+    hal_registry_lock();
+    module_slot_t *slot = g_active;
+    bool mod_ok  = slot && strcmp(slot->module_id, module_id_buf) == 0;
+    bool staged  = mod_ok && !slot->inst;
+    wasm_function_inst_t fn = mod_ok && !staged ? wasm_runtime_lookup_function(slot->inst, func_name) : NULL;
+    bool func_ok = fn != NULL;
+    bool args_ok = func_ok && parse_call_args(line, fn, slot->inst, argv, &argc, err, sizeof(err));
+
+    int idx = -1;
+    for (int i = 0; i < AGENT_MAX_SCHEDULES && args_ok; i++) {
+        if (!g_schedules[i].used) {
+            idx = i;
+            break;
+        }
+    }
+    if (idx >= 0) {
+        schedule_t *sc = &g_schedules[idx];
+        memset(sc, 0, sizeof(*sc));
+        sc->id        = g_next_sched_id++;
+        strncpy(sc->module_id, module_id_buf, sizeof(sc->module_id) - 1);
+        strncpy(sc->func_name, func_name, sizeof(sc->func_name) - 1);
+        sc->argc      = argc;
+        memcpy(sc->argv, argv, sizeof(uint64_t) * argc);
+        sc->period_ms = period_ms;
+        sc->max_runs  = max_runs;
+        sc->stream    = strcmp(mode, "stream") == 0;
+        sc->used      = true;
+    }
+    hal_registry_unlock();
+
+    if (!mod_ok) {
+        hal_write_str("SCHEDULE_ERR code=NO_MODULE\n");
+        return;
+    }
+    if (staged) {
+        hal_write_str("SCHEDULE_ERR code=BUSY msg=\"module staged\"\n");
+        return;
+    }
+    if (!func_ok) {
+        snprintf(out_buf, sizeof(out_buf), "SCHEDULE_ERR code=NO_FUNC name=%s\n", func_name);
+        hal_write_str(out_buf);
+        return;
+    }
+    if (!args_ok) {
+        snprintf(out_buf, sizeof(out_buf), "SCHEDULE_ERR code=BAD_PARAMS msg=\"%s\"\n", err);
+        hal_write_str(out_buf);
+        return;
+    }
+    if (idx < 0) {
+        hal_write_str("SCHEDULE_ERR code=NO_SLOT\n");
+        return;
+    }
+
+    hal_timer_start(idx, delay_ms, period_ms);
+
+    snprintf(out_buf, sizeof(out_buf), "SCHEDULE_OK sched_id=%lu\n",
+             (unsigned long)g_schedules[idx].id);
+    hal_write_str(out_buf);
+}
+
+
+// Gestione comando UNSCHEDULE sched_id=<n>: ferma il timer (e il tick in corso, via should_stop)
+static void handle_unschedule_cmd(const char *line)
+{
+    char out_buf[96];
+    uint32_t id = param_u32(line, "sched_id", 0);
+    int idx = -1;
+    uint32_t runs = 0, missed = 0;
+
+    hal_registry_lock();
+    for (int i = 0; i < AGENT_MAX_SCHEDULES; i++) {
+        if (g_schedules[i].used && g_schedules[i].id == id) {
+            idx = i;
+            break;
+        }
+    }
+    if (idx >= 0) {
+        hal_timer_stop(idx);
+        runs   = g_schedules[idx].runs;
+        missed = atomic_load(&g_schedules[idx].missed);
+        g_schedules[idx].used = false;
+        atomic_store(&g_schedules[idx].due, false);
+        for (int c = 0; c < AGENT_PRIO_CLASSES; c++) {
+            if (g_runners[c].busy && g_runners[c].running_sched == id) {
+                g_runners[c].stop = true;
+            }
+        }
+    }
+    hal_registry_unlock();
+
+    if (idx < 0) {
+        hal_write_str("UNSCHEDULE_ERR code=NOT_FOUND\n");
+        return;
+    }
+    snprintf(out_buf, sizeof(out_buf), "UNSCHEDULE_OK sched_id=%lu runs=%lu missed=%lu\n",
+             (unsigned long)id, (unsigned long)runs, (unsigned long)missed);
+    hal_write_str(out_buf);
+}
+
+
+// Gestione comando FETCH [max=N]: svuota il ring dei risultati schedulati
+/* Risposta: N righe SRESULT ..., poi FETCH_OK count=N pending=<rimasti> dropped=<persi dall'ultimo FETCH> */
+static void handle_fetch_cmd(const char *line)
+{
+    char out_buf[256];
+    uint32_t max = param_u32(line, "max", SCHED_RESULTS);
+    uint32_t count = 0;
+
+    while (count < max) {
+        sched_result_t r;
+        bool have = false;
+
+        hal_registry_lock();
+        if (g_results_count > 0) {
+            r = g_results[g_results_head];
+            g_results_head = (g_results_head + 1) % SCHED_RESULTS;
+            g_results_count--;
+            have = true;
+        }
+        hal_registry_unlock();
+
+        if (!have) {
+            break;
+        }
+        format_sched_result(&r, out_buf, sizeof(out_buf));
+        hal_write_str(out_buf);
+        count++;
+    }
+
+    hal_registry_lock();
+    uint32_t pending = g_results_count;
+    uint32_t dropped = g_results_dropped;
+    g_results_dropped = 0;
+    hal_registry_unlock();
+
+    snprintf(out_buf, sizeof(out_buf), "FETCH_OK count=%lu pending=%lu dropped=%lu\n",
+             (unsigned long)count, (unsigned long)pending, (unsigned long)dropped);
+    hal_write_str(out_buf);
+}
+
+// Timer HAL scaduto (contesto ISR su Zephyr): solo flag + notifica al RUNNER della classe normal
+void agent_timer_expired(int id)
+{
+    if (id < 0 || id >= AGENT_MAX_SCHEDULES || !g_schedules[id].used) {
+        return;
+    }
+    if (atomic_exchange(&g_schedules[id].due, true)) {
+        atomic_fetch_add(&g_schedules[id].missed, 1);   // il tick precedente non è ancora partito: accorpato
+    }
+    hal_runner_notify(PRIO_NORMAL);
+}
+
+// Gestione comando SIGS: firme delle funzioni esportate dalla versione attiva (il gateway le tiene
+// in cache e valida gli args prima di inviare START/SCHEDULE)
+/* Risposta: una riga per export funzione, poi il riepilogo
+      SIG func=add params=i32,i32 results=i32
+      SIG func=toggle_forever params=- results=-
+      SIGS_OK module_id=<id> version=<n> count=<n>
+*/
+static void handle_sigs_cmd(const char *line)
+{
+    (void)line;
+    char out_buf[160];
+
+    // riferimento alla versione attiva: un LOAD durante l'elenco non può scaricarla
+    hal_registry_lock();
+    module_slot_t *slot = g_active;
+    bool staged = slot && !slot->inst;
+    if (slot && !staged) {
+        slot->refs++;
+    }
+    hal_registry_unlock();
+
+    if (!slot) {
+        hal_write_str("SIGS_ERR code=NO_MODULE\n");
+        return;
+    }
+    if (staged) {
+        hal_write_str("SIGS_ERR code=BUSY msg=\"module staged\"\n");
+        return;
+    }
+
+    uint32_t count   = 0;
+    int32_t  exports = wasm_runtime_get_export_count(slot->module);
+    for (int32_t i = 0; i < exports; i++) {
+        wasm_export_t exp;
+        wasm_runtime_get_export_type(slot->module, i, &exp);
+        if (exp.kind != WASM_IMPORT_EXPORT_KIND_FUNC) {
+            continue;
+        }
+        wasm_function_inst_t fn = wasm_runtime_lookup_function(slot->inst, exp.name);
+        if (!fn) {
+            continue;
+        }
+
+        wasm_valkind_t types[MAX_CALL_ARGS > MAX_CALL_RESULTS ? MAX_CALL_ARGS : MAX_CALL_RESULTS];
+        uint32_t n_params  = wasm_func_get_param_count(fn, slot->inst);
+        uint32_t n_results = wasm_func_get_result_count(fn, slot->inst);
+        int n = snprintf(out_buf, sizeof(out_buf), "SIG func=%s params=", exp.name);
+
+        // oltre i limiti del protocollo la firma è riportata come "*" (funzione non chiamabile)
+        if (n_params == 0) {
+            n += snprintf(out_buf + n, sizeof(out_buf) - (size_t)n, "-");
+        } else if (n_params > MAX_CALL_ARGS) {
+            n += snprintf(out_buf + n, sizeof(out_buf) - (size_t)n, "*");
+        } else {
+            wasm_func_get_param_types(fn, slot->inst, types);
+            for (uint32_t k = 0; k < n_params && (size_t)n < sizeof(out_buf); k++) {
+                n += snprintf(out_buf + n, sizeof(out_buf) - (size_t)n, "%s%s",
+                              k ? "," : "", valkind_name(types[k]));
+            }
+        }
+        if ((size_t)n < sizeof(out_buf)) {
+            n += snprintf(out_buf + n, sizeof(out_buf) - (size_t)n, " results=");
+        }
+        if ((size_t)n >= sizeof(out_buf)) {
+            continue;   // nome troppo lungo per la riga
+        }
+        if (n_results == 0) {
+            n += snprintf(out_buf + n, sizeof(out_buf) - (size_t)n, "-");
+        } else if (n_results > MAX_CALL_RESULTS) {
+            n += snprintf(out_buf + n, sizeof(out_buf) - (size_t)n, "*");
+        } else {
+            wasm_func_get_result_types(fn, slot->inst, types);
+            for (uint32_t k = 0; k < n_results && (size_t)n < sizeof(out_buf); k++) {
+                n += snprintf(out_buf + n, sizeof(out_buf) - (size_t)n, "%s%s",
+                              k ? "," : "", valkind_name(types[k]));
+            }
+        }
+        if ((size_t)n + 1 < sizeof(out_buf)) {
+            out_buf[n]     = '\n';
+            out_buf[n + 1] = '\0';
+            hal_write_str(out_buf);
+            count++;
+        }
+    }
+
+    snprintf(out_buf, sizeof(out_buf), "SIGS_OK module_id=%s version=%lu count=%lu\n",
+             slot->module_id, (unsigned long)slot->version, (unsigned long)count);
+    hal_write_str(out_buf);
+    registry_release(slot);
+}
+
+// Gestione generica linea comando (COMM thread)
+static void handle_command_line(char *line)
+{
+    // rimuove newline finale
+    size_t len = strlen(line);
+    if (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+        line[len-1] = '\0';
+
+    // comando = prima parola
+    char *cmd  = strtok(line, " "); // cerca il primo spazio nella stringa, modifica line inserendo '\0' al posto dello spazio, ritorna un puntatore al comando
+    char *rest = strtok(NULL, ""); // NULL = continua dal token precedente, "" = nessun delimitatore, prende tutto il resto della linea
+
+    if (!cmd)
+        return;
+
+    if (strcmp(cmd, "LOAD") == 0) {
+        handle_load_cmd(rest ? rest : "");  // rest ? rest : "" → se rest è NULL (no argomenti), passa stringa vuota
+    } else if (strcmp(cmd, "START") == 0) {
+        handle_start_cmd(rest ? rest : "");
+    } else if (strcmp(cmd, "STOP") == 0) {
+        handle_stop_cmd(rest ? rest : "");
+    } else if (strcmp(cmd, "STATUS") == 0) {
+        handle_status_cmd(rest ? rest : "");
+    } else if (strcmp(cmd, "SCHEDULE") == 0) {
+        handle_schedule_cmd(rest ? rest : "");
+    } else if (strcmp(cmd, "UNSCHEDULE") == 0) {
+        handle_unschedule_cmd(rest ? rest : "");
+    } else if (strcmp(cmd, "FETCH") == 0) {
+        handle_fetch_cmd(rest ? rest : "");
+    } else if (strcmp(cmd, "SIGS") == 0) {
+        handle_sigs_cmd(rest ? rest : "");
+    } else {
+        hal_write_str("ERROR code=UNKNOWN_COMMAND\n");
+    }
+}
+
+// Inizializzazione runtime WAMR
+bool agent_runtime_init(void)
+{
+    RuntimeInitArgs init_args;      // struct definita da WAMR che contiene tutti i parametri di inizializzazione del runtime
+    memset(&init_args, 0, sizeof(init_args));   // azzera tutti i campi per partire da uno stato noto
+
+    init_args.mem_alloc_type   = Alloc_With_System_Allocator;   // Dice a WAMR come allocare memoria: Alloc_With_System_Allocator = usa il malloc/free di sistema (quello fornito da Zephyr / libc) per tutte le allocazioni interne del runtime
+
+    // Qui registriamo le native functions (funzioni C del firmware chiamabili dal Wasm) sotto il modulo "env"
+    init_args.native_module_name = "env";
+    init_args.native_symbols     = native_symbols;  //native_symbols è un array di NativeSymbol definito da noi, che contiene voci tipo nome esportato ("gpio_toggle"), puntatore alla funzione C, signature WAMR (tipi argomenti/ritorno).
+    init_args.n_native_symbols   =
+        sizeof(native_symbols) / sizeof(native_symbols[0]);  // n_native_symbols è il numero di elementi dell’array calcolato come numero di byte totali occupati dall’array diviso il numero di byte di un singolo elemento
+
+    if (!wasm_runtime_full_init(&init_args)) {  // Chiama l’API WAMR “completa” di init
+        hal_write_str("ERROR code=WAMR_INIT_FAIL\n");
+        return false;
+    }
+
+    #if WASM_ENABLE_LOG != 0            // Se WAMR è compilato con logging abilitato
+        bh_log_set_verbose_level(0);    // Impostare il livello di verbosità dei log interni a 0 (tipicamente “solo errori” o quasi niente), per non inondare la UART di log del runtime
+    #endif
+
+    return true;
+}
+
+// Corpo del thread COMM: comandi dal gateway
+void agent_comm_loop(void)
+{
+    char hello[128];
+    snprintf(hello, sizeof(hello),
+             "HELLO device_id=%s rtos=%s runtime=WAMR_AOT fw_version=1.0.0\n",
+             hal_device_id(), hal_rtos_name());
+    hal_write_str(hello);
+
+    char line_buf[LINE_BUF_SIZE];
+    for (;;) {
+        int n = hal_read_line(line_buf, sizeof(line_buf));  // blocca il thread finché non arriva una riga completa terminata da \n
+        if (n <= 0) {
+            continue;
+        }
+        handle_command_line(line_buf);
+    }
+}
+
+// Fine job (anche in errore): rilascia la versione usata, completa un eventuale swap staged
+// e libera il runner della classe
+static void runner_job_done(runner_t *r, module_slot_t *slot)
+{
+    if (slot) {
+        registry_release(slot);
+    }
+    registry_instantiate_staged();
+
+    hal_registry_lock();
+    r->busy          = false;
+    r->stop          = false;
+    r->running_slot  = NULL;
+    r->running_job   = 0;
+    r->running_sched = 0;
+    hal_registry_unlock();
+}
+
+// Esegue func sulla versione 'slot', nell'istanza della classe del runner, misurando cicli e tempo
+// (job da START e schedulati)
+static void runner_call(runner_t *r, module_slot_t *slot, const char *func_name,
+                        uint32_t argc, const uint64_t *argv, call_outcome_t *res)
+{
+    memset(res, 0, sizeof(*res));
+
+    wasm_module_inst_t inst = slot ? slot_instance(slot, (int)(r - g_runners)) : NULL;
+    if (!inst) {     // Nessun modulo caricato
+        res->status = CALL_NO_MODULE;
+        return;
+    }
+
+    // Cerca funzione esportata nel modulo caricato
+    wasm_function_inst_t fn =
+        wasm_runtime_lookup_function(inst, func_name);
+    if (!fn) {
+        res->status = CALL_NO_FUNC;
+        return;
+    }
+
+    // Firma della versione su cui gira il job: gli argomenti sono stati convertiti a START/SCHEDULE
+    // con quella della versione attiva allora, che un hot swap può aver cambiato
+    wasm_valkind_t param_types[MAX_CALL_ARGS];
+    wasm_valkind_t result_types[MAX_CALL_RESULTS];
+    uint32_t param_count  = wasm_func_get_param_count(fn, inst);
+    uint32_t result_count = wasm_func_get_result_count(fn, inst);
+    if (param_count != argc || result_count > MAX_CALL_RESULTS) {
+        res->status = CALL_BAD_SIG;
+        return;
+    }
+    wasm_func_get_param_types(fn, inst, param_types);
+    wasm_func_get_result_types(fn, inst, result_types);
+
+    wasm_val_t args[MAX_CALL_ARGS];
+    wasm_val_t results[MAX_CALL_RESULTS];
+    memset(args, 0, sizeof(args));
+    memset(results, 0, sizeof(results));
+    for (uint32_t i = 0; i < argc; i++) {
+        args[i].kind = param_types[i];
+        switch (param_types[i]) {
+        case WASM_I32: args[i].of.i32 = (int32_t)(uint32_t)argv[i]; break;
+        case WASM_I64: args[i].of.i64 = (int64_t)argv[i]; break;
+        case WASM_F32: {
+            uint32_t u = (uint32_t)argv[i];
+            memcpy(&args[i].of.f32, &u, sizeof(u));
+            break;
+        }
+        case WASM_F64: memcpy(&args[i].of.f64, &argv[i], sizeof(argv[i])); break;
+        default:
+            res->status = CALL_BAD_SIG;   // v128/ref: non rappresentabili nel protocollo testuale
+            return;
+        }
+    }
+
+    wasm_exec_env_t exec_env =
+        wasm_runtime_create_exec_env(inst, CONFIG_APP_STACK_SIZE);
+    if (!exec_env) {
+        res->status = CALL_NO_EXEC_ENV;
+        return;
+    }
+    wasm_runtime_set_user_data(exec_env, r);   // should_stop legge lo STOP di questo runner
+
+    // misura del job: cicli CPU e tempo, riportati nel RESULT (il gateway li usa per la promozione ad AOT)
+    uint32_t cyc_start = hal_cycle_count();
+    uint32_t us_start  = hal_uptime_us();
+
+    bool ok = wasm_runtime_call_wasm_a(exec_env, fn, result_count, results, argc, args);
+
+    res->cycles  = hal_cycle_count() - cyc_start;
+    res->exec_us = hal_uptime_us() - us_start;
+
+    if (!ok) {
+        const char *exc = wasm_runtime_get_exception(inst);
+        res->status = CALL_EXCEPTION;
+        strncpy(res->exc, exc ? exc : "<none>", sizeof(res->exc) - 1);
+    } else if (r->stop) {
+        res->status = CALL_STOPPED;
+    } else {
+        // tutti i risultati, ciascuno con il suo tipo (multi-value)
+        res->status    = CALL_OK;
+        res->ret.count = (uint8_t)result_count;
+        for (uint32_t i = 0; i < result_count; i++) {
+            res->ret.kinds[i] = result_types[i];
+            switch (result_types[i]) {
+            case WASM_I32: res->ret.bits[i] = (uint32_t)results[i].of.i32; break;
+            case WASM_I64: res->ret.bits[i] = (uint64_t)results[i].of.i64; break;
+            case WASM_F32: {
+                uint32_t u;
+                memcpy(&u, &results[i].of.f32, sizeof(u));
+                res->ret.bits[i] = u;
+                break;
+            }
+            case WASM_F64: memcpy(&res->ret.bits[i], &results[i].of.f64, sizeof(uint64_t)); break;
+            default:       res->ret.bits[i] = 0; break;
+            }
+        }
+    }
+
+    wasm_runtime_destroy_exec_env(exec_env);
+
+    // durata media per la stima dell'attesa in START_OK
+    exec_stats_update(func_name, res->exec_us);
+}
+
+// Job da START: preleva dalla coda della classe il job con la deadline più vicina, lo esegue
+// e invia RESULT. Ritorna false se la coda è vuota
+static bool runner_run_request(runner_t *r)
+{
+    int         cls  = (int)(r - g_runners);
+    const char *prio = g_prio_names[cls];
+    run_request_t req;
+    int best = -1;
+
+    hal_registry_lock();
+    for (uint32_t i = 0; i < r->queued; i++) {
+        if (best < 0 || job_earlier(&r->queue[i], &r->queue[best])) {
+            best = (int)i;
+        }
+    }
+    if (best < 0) {
+        hal_registry_unlock();
+        return false;
+    }
+    // COPIA locale: il posto in coda torna subito disponibile per START
+    req = r->queue[best];
+    r->queue[best] = r->queue[--r->queued];
+    uint32_t now = hal_uptime_ms();
+    r->busy          = true;
+    r->stop          = false;
+    r->running_slot  = req.slot;
+    r->running_job   = req.job_id;
+    r->running_sched = 0;
+    r->running_since = now;
+    strncpy(r->running_func, req.func_name, sizeof(r->running_func) - 1);
+    hal_registry_unlock();
+
+    // prepara RESULT (fino a MAX_CALL_RESULTS valori f64 con tutte le cifre)
+    char out[320];
+    int  n;
+
+    // deadline già scaduta in coda: il job non parte (EDF con deadline ferme)
+    if (req.has_deadline && (int32_t)(now - req.deadline) > 0) {
+        snprintf(out, sizeof(out),
+                 "RESULT status=EXPIRED func=%s job_id=%lu prio=%s late_ms=%lu\n",
+                 req.func_name, (unsigned long)req.job_id, prio,
+                 (unsigned long)(now - req.deadline));
+        hal_write_str(out);
+        runner_job_done(r, req.slot);
+        return true;
+    }
+
+    call_outcome_t res;
+    runner_call(r, req.slot, req.func_name, req.argc, req.argv, &res);
+    bool late = req.has_deadline && (int32_t)(hal_uptime_ms() - req.deadline) > 0;
+
+    switch (res.status) {
+    case CALL_NO_MODULE:
+        snprintf(out, sizeof(out), "RESULT status=NO_MODULE job_id=%lu prio=%s\n",
+                 (unsigned long)req.job_id, prio);
+        hal_write_str(out);
+        runner_job_done(r, req.slot);
+        return true;
+    case CALL_NO_FUNC:
+        snprintf(out, sizeof(out),
+                 "RESULT status=NO_FUNC name=%s job_id=%lu prio=%s\n",
+                 req.func_name, (unsigned long)req.job_id, prio);
+        hal_write_str(out);
+        runner_job_done(r, req.slot);
+        return true;
+    case CALL_NO_EXEC_ENV:
+        snprintf(out, sizeof(out),
+                 "RESULT status=NO_EXEC_ENV func=%s job_id=%lu prio=%s\n",
+                 req.func_name, (unsigned long)req.job_id, prio);
+        hal_write_str(out);
+        runner_job_done(r, req.slot);
+        return true;
+    case CALL_EXCEPTION:
+        n = snprintf(out, sizeof(out),
+                     "RESULT status=EXCEPTION func=%s msg=\"%s\"",
+                     req.func_name, res.exc);
+        break;
+    case CALL_STOPPED:
+        n = snprintf(out, sizeof(out),
+                     "RESULT status=STOPPED func=%s",
+                     req.func_name);
+        break;
+    case CALL_BAD_SIG:
+        n = snprintf(out, sizeof(out),
+                     "RESULT status=BAD_SIG func=%s msg=\"signature changed\"",
+                     req.func_name);
+        break;
+    default:
+        // Nessun risultato (void): solo status; altrimenti ret_i32= oppure ret=/ret_types=
+        n = snprintf(out, sizeof(out),
+                     "RESULT status=OK func=%s",
+                     req.func_name);
+        n = format_call_values(out, sizeof(out), n, &res.ret);
+        break;
+    }
+
+    // coda comune: job, tier e misure del job
+    if (n > 0 && (size_t)n < sizeof(out)) {
+        n += snprintf(out + n, sizeof(out) - (size_t)n,
+                      " job_id=%lu prio=%s%s%s tier=%s version=%lu cycles=%lu exec_us=%lu%s\n",
+                      (unsigned long)req.job_id,
+                      prio,
+                      req.requested_cls != cls ? " requested=" : "",
+                      req.requested_cls != cls ? g_prio_names[req.requested_cls] : "",
+                      module_tier(req.slot),
+                      (unsigned long)req.slot->version,
+                      (unsigned long)res.cycles,
+                      (unsigned long)res.exec_us,
+                      late ? " deadline_miss=1" : "");
+    }
+    if (n < 0 || (size_t)n >= sizeof(out)) {   // riga troncata: termina comunque con \n
+        out[sizeof(out) - 2] = '\n';
+        out[sizeof(out) - 1] = '\0';
+    }
+
+    hal_write_str(out);
+
+    // reset stato runner (ed eventuale ritiro della versione sostituita durante il job)
+    runner_job_done(r, req.slot);
+    return true;
+}
+
+// Job schedulati (solo runner normal): esegue un tick scaduto. Ritorna false se non ce ne sono,
+// così il loop alterna tick e START in coda senza che gli uni affamino gli altri
+static bool runner_run_schedules(runner_t *r)
+{
+    for (int i = 0; i < AGENT_MAX_SCHEDULES; i++) {
+        // il tick si prende azzerando 'due' in un colpo solo: una scadenza che arriva da qui in
+        // poi resta marcata e gira al giro successivo, invece di perdersi tra copia e azzeramento
+        if (!g_schedules[i].used || !atomic_exchange(&g_schedules[i].due, false)) {
+            continue;
+        }
+
+        // copia dello schedule: UNSCHEDULE può liberare lo slot mentre il job gira
+        hal_registry_lock();
+        schedule_t sc = g_schedules[i];
+        module_slot_t *slot = NULL;
+        if (sc.used && g_active && g_active->inst &&
+            strcmp(g_active->module_id, sc.module_id) == 0) {
+            slot = g_active;
+            slot->refs++;
+        }
+        r->busy          = sc.used;
+        r->stop          = false;
+        r->running_slot  = slot;
+        r->running_job   = 0;
+        r->running_sched = sc.used ? sc.id : 0;
+        r->running_since = hal_uptime_ms();
+        strncpy(r->running_func, sc.func_name, sizeof(r->running_func) - 1);
+        hal_registry_unlock();
+
+        if (!sc.used) {
+            continue;
+        }
+
+        call_outcome_t res;
+        runner_call(r, slot, sc.func_name, sc.argc, sc.argv, &res);
+
+        sched_result_t rr;
+        memset(&rr, 0, sizeof(rr));
+        rr.sched_id = sc.id;
+        rr.t_ms     = hal_uptime_ms();
+        rr.status   = (uint8_t)res.status;
+        rr.ret      = res.ret;
+        rr.cycles   = res.cycles;
+        rr.exec_us  = res.exec_us;
+
+        hal_registry_lock();
+        if (g_schedules[i].used && g_schedules[i].id == sc.id) {
+            rr.seq = ++g_schedules[i].runs;
+            if (sc.max_runs && rr.seq >= sc.max_runs) {
+                hal_timer_stop(i);              // ultima esecuzione: schedule concluso
+                g_schedules[i].used = false;
+                atomic_store(&g_schedules[i].due, false);
+            }
+        } else {
+            rr.seq = sc.runs + 1;               // rimosso da UNSCHEDULE durante il job
+        }
+        if (!sc.stream) {
+            results_push(&rr);
+        }
+        hal_registry_unlock();
+
+        if (sc.stream) {
+            char out[256];
+            format_sched_result(&rr, out, sizeof(out));
+            hal_write_str(out);
+        }
+
+        runner_job_done(r, slot);
+        return true;
+    }
+    return false;
+}
+
+// Corpo del thread RUNNER di una classe: esegue le funzioni Wasm
+void agent_runner_loop(int prio_class)
+{
+    if (prio_class < 0 || prio_class >= AGENT_PRIO_CLASSES) {
+        return;
+    }
+    runner_t *r = &g_runners[prio_class];
+
+    if (!wasm_runtime_init_thread_env()) {   // OGNI thread WAMR deve inizializzare il proprio ambiente thread-local
+        hal_write_str("ERROR code=WAMR_THREAD_ENV_INIT_FAIL\n");
+        return;
+    }
+
+    for (;;) {
+        hal_runner_wait(prio_class);    // BLOCCATO: aspetta un job dal COMM thread o un tick dei timer
+
+        // svuota coda e tick scaduti prima di tornare in attesa (le notifiche si possono accorpare)
+        bool worked;
+        do {
+            worked = runner_run_request(r);
+            if (prio_class == PRIO_NORMAL) {
+                worked = runner_run_schedules(r) || worked;
+            }
+        } while (worked);
+    }
+
+
+    wasm_runtime_destroy_thread_env();
+}
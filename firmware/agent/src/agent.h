@@ -0,0 +1,38 @@
+#ifndef AGENT_CORE_H
+#define AGENT_CORE_H
+
+/*
+    Core dell'agent, indipendente dalla piattaforma: protocollo testuale
+    (LOAD/START/STOP/STATUS/SCHEDULE/FETCH/SIGS), registry dei moduli Wasm/AOT e runner.
+    La HAL (hal.h) crea i thread e chiama queste funzioni.
+*/
+
+#include <stdbool.h>
+
+// Config WAMR
+#define CONFIG_APP_STACK_SIZE       8192
+#define CONFIG_APP_HEAP_SIZE        8192
+
+// dimensione massima riga comando (LOAD ..., START ..., ecc.)
+#define LINE_BUF_SIZE 256
+
+// numero massimo di SCHEDULE attivi (uno per timer della HAL)
+#define AGENT_MAX_SCHEDULES 4
+
+// classi di priorità di START (0 = high, 1 = normal, 2 = low): un thread RUNNER per classe
+#define AGENT_PRIO_CLASSES  3
+
+// Inizializza il runtime WAMR e registra le funzioni native del modulo "env"
+bool agent_runtime_init(void);
+
+// Corpo del thread COMM: invia HELLO, poi legge e gestisce i comandi per sempre
+void agent_comm_loop(void);
+
+// Corpo del thread RUNNER della classe 'prio_class': esegue le funzioni Wasm richieste da START
+// (coda EDF della classe) e, nella classe normal, i tick degli SCHEDULE
+void agent_runner_loop(int prio_class);
+
+// Chiamata dalla HAL alla scadenza del timer 'id' (anche da ISR: non blocca)
+void agent_timer_expired(int id);
+
+#endif /* AGENT_CORE_H */
@@ -0,0 +1,57 @@
+#ifndef AGENT_HAL_H
+#define AGENT_HAL_H
+
+/*
+    HAL dell'agent: tutto ciò che dipende dalla piattaforma (driver Zephyr su STM32,
+    oppure socket/pthread su Linux) sta dietro queste funzioni. Il core dell'agent
+    (agent.c: protocollo, registry dei moduli, runner) usa solo questa interfaccia e WAMR.
+
+    Implementazioni:
+        src/hal_zephyr.c   → UART con ISR + message queue, GPIO del LED, thread Zephyr
+        posix/hal_posix.c  → socket TCP (stesso protocollo del bridge Renode), pthread
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Identità riportata nella riga HELLO
+const char *hal_device_id(void);
+const char *hal_rtos_name(void);
+
+// Canale comandi verso il gateway
+void hal_write_str(const char *s);                  // invia una stringa (già terminata da \n)
+int  hal_read_line(char *buf, size_t max_len);      // bloccante: ritorna la lunghezza della riga, <= 0 se nessuna riga
+
+/*  Ricezione del payload binario di LOAD, in due fasi:
+        hal_binary_arm()  prepara la ricezione di 'size' byte in 'buf' PRIMA che l'agent invii LOAD_READY
+                          (i byte possono arrivare subito dopo la risposta)
+        hal_binary_wait() attende che il payload sia completo; 0 = ok, -1 = timeout (ricezione annullata)
+*/
+void hal_binary_arm(uint8_t *buf, size_t size);
+int  hal_binary_wait(uint32_t timeout_ms);
+
+// Notifica COMM → RUNNER della classe 'prio_class' (< AGENT_PRIO_CLASSES): un nuovo job è in coda.
+// La HAL crea un thread RUNNER per classe, con priorità decrescente e tutte sotto il COMM thread
+void hal_runner_notify(int prio_class);
+void hal_runner_wait(int prio_class);
+
+// Mutex del registry (versioni dei moduli, schedule, ring dei risultati), condiviso tra COMM e RUNNER
+void hal_registry_lock(void);
+void hal_registry_unlock(void);
+
+// Timer per SCHEDULE (id < AGENT_MAX_SCHEDULES): primo tick dopo delay_ms, poi ogni period_ms
+// (0 = one-shot). Alla scadenza la HAL chiama agent_timer_expired(id)
+void hal_timer_start(int id, uint32_t delay_ms, uint32_t period_ms);
+void hal_timer_stop(int id);
+
+// Native env.gpio_toggle: commuta il LED e attende il periodo di lampeggio
+void hal_gpio_toggle(void);
+
+// Misura dei job: contatore di cicli CPU a 32 bit (va in overflow, usare differenze) e tempo in µs
+uint32_t hal_cycle_count(void);
+uint32_t hal_uptime_us(void);
+
+// Uptime in ms (deadline di START, t_ms degli SCHEDULE): overflow dopo ~49 giorni, usare differenze
+uint32_t hal_uptime_ms(void);
+
+#endif /* AGENT_HAL_H */
@@ -0,0 +1,402 @@
+#include <stm32f4xx.h>    //Header HAL/LL STM32F4: definizioni di registri, interrupt, ecc. specifiche della MCU
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <zephyr/kernel.h>
+
+// API per oggetti struct device e driver UART/GPIO
+#include <zephyr/device.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/drivers/gpio.h>
+
+#include "agent.h"
+#include "hal.h"
+
+
+// UART usata per agent/orchestrator
+#define UART_DEVICE_NODE DT_CHOSEN(zephyr_shell_uart)   // DT_CHOSEN(zephyr_shell_uart) prende dalla Devicetree il nodo marcato come zephyr,shell-uart nella sezione chosen
+
+// LED usato da gpio_toggle
+#define LED0_NODE DT_ALIAS(led0)    // DT_ALIAS(led0) prende il nodo con alias led0 nella Devicetree della board
+
+/*
+    K_MSGQ_DEFINE(name, msg_size, max_msgs, align) definisce staticamente una message queue di Zephyr:
+        uart_msgq: coda usata per passare le linee di testo dal ISR UART al COMM thread
+        msg_size = LINE_BUF_SIZE → ogni messaggio è un buffer da 256 byte
+        max_msgs = 4 → la coda può contenere fino a 4 linee pendenti
+        align = 4 → allineamento a 4 byte
+*/
+K_MSGQ_DEFINE(uart_msgq, LINE_BUF_SIZE, 4, 4);
+
+// device UART; struct device è un tipo definito da Zephyr
+static const struct device *uart_dev;
+
+// buffer RX usato in ISR
+static char rx_buf[LINE_BUF_SIZE];
+static int  rx_buf_pos;
+
+// Stato RX per comandi testuali e payload binario (LOAD)
+typedef enum {
+    RX_STATE_LINE = 0,
+    RX_STATE_BINARY
+} rx_state_t;
+
+static volatile rx_state_t g_rx_state = RX_STATE_LINE; // variabile globale che contiene lo stato corrente della RX UART
+
+// puntatore buffer binario e dimensioni attese
+static uint8_t *g_bin_buf      = NULL;
+static size_t   g_bin_expected = 0;
+static size_t   g_bin_received = 0;
+
+// semaforo per notificare al thread che il payload è completo; valore iniziale 0 e valore massimo 1
+K_SEM_DEFINE(bin_sem, 0, 1);
+
+// semafori usati per svegliare i RUNNER quando c'è un nuovo job (uno per classe di priorità)
+static struct k_sem run_sems[AGENT_PRIO_CLASSES];
+
+// mutex del registry dei moduli (hot swap tra COMM e RUNNER)
+K_MUTEX_DEFINE(registry_mutex);
+
+// più thread scrivono sulla UART (COMM e i RUNNER, che si prelazionano a vicenda): una riga alla volta.
+// k_mutex ha priority inheritance, quindi un RUNNER low che tiene la UART non blocca a lungo il COMM
+K_MUTEX_DEFINE(tx_mutex);
+
+// un k_timer per ogni SCHEDULE; la expiry function gira in contesto ISR
+static struct k_timer sched_timers[AGENT_MAX_SCHEDULES];
+
+// Thread config
+#define COMM_THREAD_STACK_SIZE    8192
+#define COMM_THREAD_PRIORITY      5
+
+#define RUNNER_THREAD_STACK_SIZE  8192
+
+// un RUNNER per classe (high, normal, low): priorità numericamente più alte = meno urgenti,
+// tutte sotto il COMM thread, così un job high interrompe un job normal/low in esecuzione.
+// Budget RAM sulla F446 (128 KB): pool WAMR 64 KB (CMakeLists.txt), stack COMM + 3 RUNNER
+// 4 × 8 KB = 32 KB statici, il resto a kernel, stack di main e heap di sistema (binari dei moduli).
+// Il pool contiene una sola istanza di un modulo con memoria lineare: i job high/low ripiegano
+// sul RUNNER normal (registry_class_instance), i loro thread lavorano solo con moduli senza memoria
+static const int runner_thread_priority[AGENT_PRIO_CLASSES] = { 6, 7, 8 };
+
+// K_THREAD_STACK_DEFINE(name, size) alloca staticamente un blocco di RAM allineato per usarlo come stack di un thread Zephyr
+K_THREAD_STACK_DEFINE(comm_thread_stack,   COMM_THREAD_STACK_SIZE);  // stack associato al COMM thread
+K_THREAD_STACK_ARRAY_DEFINE(runner_thread_stacks, AGENT_PRIO_CLASSES, RUNNER_THREAD_STACK_SIZE);  // uno stack per RUNNER
+
+// struct k_thread è la struttura kernel che contiene lo stato del thread
+static struct k_thread comm_thread;
+static struct k_thread runner_threads[AGENT_PRIO_CLASSES];
+
+
+// UART ISR
+static void serial_cb(const struct device *dev, void *user_data)
+{
+    uint8_t c;
+
+    ARG_UNUSED(dev);
+    ARG_UNUSED(user_data);
+
+    if (!uart_irq_update(uart_dev)) {  // aggiorna gli status dei flag di interrupt
+        return;
+    }
+
+    if (!uart_irq_rx_ready(uart_dev)) {  // controlla se ci sono dati nella FIFO RX
+        return;
+    }
+
+    while (uart_fifo_read(uart_dev, &c, 1) == 1) {    // Legge byte dalla FIFO uno alla volta finché uart_fifo_read restituisce 1
+        if (g_rx_state == RX_STATE_LINE) {
+            // modalità line-based: accumula fino a \n / \r
+            if ((c == '\n' || c == '\r') && rx_buf_pos > 0) {  // quando vede \n o \r e c’è almeno un carattere nel buffer
+                rx_buf[rx_buf_pos] = '\0';          // chiude la stringa con '\0'
+                k_msgq_put(&uart_msgq, &rx_buf, K_NO_WAIT); // mette la linea completa nella message queue uart_msgq. Se la coda è piena, il messaggio viene scartato
+                rx_buf_pos = 0;
+            } else if (rx_buf_pos < (int)(sizeof(rx_buf) - 1)) {   // Se non è fine linea ed il buffer non è pieno
+                rx_buf[rx_buf_pos++] = (char)c;         // aggiunge il carattere al buffer e incrementa rx_buf_pos
+            }
+        } else if (g_rx_state == RX_STATE_BINARY) {
+            // modalità binaria: copia direttamente nel buffer WASM/AOT
+            if (g_bin_buf != NULL && g_bin_received < g_bin_expected) {
+                g_bin_buf[g_bin_received++] = c;   // ogni byte ricevuto viene copiato direttamente nel buffer binario g_bin_buf e si incrementa g_bin_received
+
+                if (g_bin_received == g_bin_expected) {
+                    // payload completo: ritorna a modalità line-based e sveglia il thread che sta aspettando
+                    g_rx_state = RX_STATE_LINE;
+                    k_sem_give(&bin_sem);  //  incrementa il semaforo bin_sem da 0 a 1 e sblocca immediatamente il thread che stava aspettando su k_sem_take
+                }
+            }
+        }
+    }
+}
+
+// GPIO per gpio_toggle
+static const struct device *gpio_dev;
+static uint32_t gpio_pin;
+
+static int gpio_init_for_wasm(void)
+{
+     /*  legge dalla Devicetree il nodo LED0_NODE e costruisce una struct gpio_dt_spec con:
+                led.port: const struct device * del controller GPIO;
+                led.pin: numero di pin;
+                led.dt_flags: flag di configurazione definiti in Devicetree (active low, pull‑up, ecc.)
+     */
+    const struct gpio_dt_spec led = GPIO_DT_SPEC_GET(LED0_NODE, gpios);
+
+    if (!device_is_ready(led.port)) { // Controlla che il driver del GPIO relativo a led.port sia stato inizializzato correttamente dal kernel
+        return -1;
+    }
+
+    if (gpio_pin_configure_dt(&led, GPIO_OUTPUT_INACTIVE) < 0) { // configura il pin descritto da led come output e inizialmente “inactive”
+        return -1;
+    }
+
+    gpio_dev = led.port; // device controller del LED
+    gpio_pin = led.pin;  // numero di pin del LED
+    return 0;
+}
+
+#define SLEEP_TIME_MS 1000
+
+// HAL: env.gpio_toggle
+void hal_gpio_toggle(void)
+{
+    if (!gpio_dev) {
+        return;
+    }
+
+    gpio_pin_toggle(gpio_dev, gpio_pin);
+    k_msleep(SLEEP_TIME_MS);
+}
+
+// HAL: contatore cicli (a 180 MHz fa overflow dopo ~23 s) e uptime
+uint32_t hal_cycle_count(void)
+{
+    return k_cycle_get_32();
+}
+
+uint32_t hal_uptime_us(void)
+{
+    return (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+uint32_t hal_uptime_ms(void)
+{
+    return k_uptime_get_32();
+}
+
+const char *hal_device_id(void)
+{
+    return "stm32f4_01";
+}
+
+const char *hal_rtos_name(void)
+{
+    return "Zephyr";
+}
+
+// HAL: ricezione payload binario di LOAD
+void hal_binary_arm(uint8_t *buf, size_t size)
+{
+    // SEZIONE CRITICA: configura ISR per ricevere payload binario
+    unsigned int key = irq_lock();                    // disabilita interrupt
+    g_bin_buf      = buf;                             // ISR scriverà qui
+    g_bin_expected = size;                            // quanti byte attendere
+    g_bin_received = 0;                               // contatore byte ricevuti
+    g_rx_state     = RX_STATE_BINARY;                 // ISR: passa in modalità binaria
+    k_sem_reset(&bin_sem);                            // reset semaforo (torna a 0)
+    irq_unlock(key);                                  // riabilita interrupt
+}
+
+int hal_binary_wait(uint32_t timeout_ms)
+{
+    // BLOCCA: aspetta che ISR riceva tutto il payload
+    if (k_sem_take(&bin_sem, K_MSEC(timeout_ms)) != 0) {
+        // Timeout: ISR non ha ricevuto tutto
+        unsigned int key = irq_lock();
+        g_rx_state = RX_STATE_LINE;  // torna a comandi testuali
+        g_bin_buf  = NULL;
+        irq_unlock(key);
+        return -1;
+    }
+    return 0;
+}
+
+// HAL: notifica COMM → RUNNER (anche dall'ISR dei timer: k_sem_give non blocca)
+void hal_runner_notify(int prio_class)
+{
+    k_sem_give(&run_sems[prio_class]);
+}
+
+void hal_runner_wait(int prio_class)
+{
+    k_sem_take(&run_sems[prio_class], K_FOREVER);
+}
+
+// HAL: sezione critica del registry
+void hal_registry_lock(void)
+{
+    k_mutex_lock(&registry_mutex, K_FOREVER);
+}
+
+void hal_registry_unlock(void)
+{
+    k_mutex_unlock(&registry_mutex);
+}
+
+// HAL: timer degli SCHEDULE
+static void sched_timer_expiry(struct k_timer *timer)
+{
+    agent_timer_expired((int)(intptr_t)k_timer_user_data_get(timer));
+}
+
+void hal_timer_start(int id, uint32_t delay_ms, uint32_t period_ms)
+{
+    struct k_timer *t = &sched_timers[id];
+
+    k_timer_init(t, sched_timer_expiry, NULL);
+    k_timer_user_data_set(t, (void *)(intptr_t)id);
+    k_timer_start(t, K_MSEC(delay_ms), period_ms ? K_MSEC(period_ms) : K_NO_WAIT);
+}
+
+void hal_timer_stop(int id)
+{
+    k_timer_stop(&sched_timers[id]);
+}
+
+// Thread COMM: UART + comandi
+static void comm_thread_entry(void *arg1, void *arg2, void *arg3)
+{
+    // Qui non usiamo argomenti, quindi ARG_UNUSED serve solo a evitare warning
+    ARG_UNUSED(arg1);
+    ARG_UNUSED(arg2);
+    ARG_UNUSED(arg3);
+
+    uart_dev = DEVICE_DT_GET(UART_DEVICE_NODE);
+    if (!device_is_ready(uart_dev)) {
+        printk("UART device not ready!\n");
+        return;
+    }
+
+    int ret = uart_irq_callback_user_data_set(uart_dev, serial_cb, NULL);  //Registra serial_cb come callback di interrupt per la UART RX
+    if (ret < 0) {
+        printk("Error setting UART callback: %d\n", ret);
+        return;
+    }
+    uart_irq_rx_enable(uart_dev);  // uart_irq_rx_enable abilita gli interrupt di ricezione: da questo momento ogni byte arrivato da gateway attiva serial_cb
+
+    if (!agent_runtime_init()) { // Inizializza il runtime WAMR (heap, VM, tipi, ecc.)
+        return;
+    }
+
+    if (gpio_init_for_wasm() != 0) {    // Configura il LED scelto (LED0_NODE) come output e prepara le strutture per gpio_toggle
+        hal_write_str("ERROR code=GPIO_INIT_FAIL\n");
+        return;
+    }
+
+    agent_comm_loop();  // HELLO + gestione comandi, non ritorna
+}
+
+// Thread RUNNER: esegue le funzioni Wasm della classe passata in arg1
+static void runner_thread_entry(void *arg1, void *arg2, void *arg3)
+{
+    ARG_UNUSED(arg2);
+    ARG_UNUSED(arg3);
+
+    agent_runner_loop((int)(intptr_t)arg1);
+}
+
+
+
+// Creazione thread
+bool iwasm_init(void)
+{
+    k_tid_t tid_comm = k_thread_create(
+        &comm_thread,       // puntatore alla struct k_thread che contiene lo stato del thread
+        comm_thread_stack,  // buffer stack definito con K_THREAD_STACK_DEFINE
+        COMM_THREAD_STACK_SIZE,  // dimensione dello stack in byte
+        comm_thread_entry,      // funzione di entry del thread
+        NULL, NULL, NULL,     // tre eventuali parametri passati all’entry (qui non ne usiamo)
+        COMM_THREAD_PRIORITY,  // priorità del thread
+        0,                   // opzioni extra (nessuna flag speciale)
+        K_NO_WAIT);         // nessun ritardo di start
+
+    bool runners_ok = true;
+    for (int c = 0; c < AGENT_PRIO_CLASSES; c++) {
+        k_sem_init(&run_sems[c], 0, 1);   // valore iniziale 0, massimo 1: le notifiche si accorpano
+        k_tid_t tid_runner = k_thread_create(
+            &runner_threads[c],
+            runner_thread_stacks[c],
+            K_THREAD_STACK_SIZEOF(runner_thread_stacks[c]),
+            runner_thread_entry,
+            (void *)(intptr_t)c, NULL, NULL,   // classe di priorità servita dal thread
+            runner_thread_priority[c],
+            0,
+            K_NO_WAIT);
+        runners_ok = runners_ok && tid_runner;
+    }
+
+    return tid_comm && runners_ok;
+}
+
+// Entry Zephyr
+void main(void)
+{
+    (void)iwasm_init();
+    while (1) {
+        k_sleep(K_FOREVER); // sospende il thread indefinitamente
+    }
+}
+
+
+
+// I/O UART
+void hal_write_str(const char *buf)
+{
+    if (!uart_dev || !buf) {    // verifica che uart_dev sia inizializzato (non NULL) e che buf punti a una stringa valida (non NULL)
+        return;
+    }
+
+    int msg_len = strlen(buf);  // strlen(buf) calcola la lunghezza della stringa escludendo il '\0' finale
+
+    // la riga intera sotto tx_mutex: un thread a priorità più alta non può inserire i suoi byte a metà
+    k_mutex_lock(&tx_mutex, K_FOREVER);
+    for (int i = 0; i < msg_len; i++) { // Loop byte-per-byte: per ogni carattere da 0 a msg_len-1
+        // buf[i] → prende l'i-esimo byte della stringa
+        /* uart_poll_out(uart_dev, buf[i]) → trasmette immediatamente l'i-esimo byte sulla UART:
+                Polling/blocking: aspetta che il registro TX sia libero, scrive il byte, aspetta che sia partito
+                Garantito: non passa al byte successivo finché quello corrente non è trasmesso fisicamente
+        */
+        uart_poll_out(uart_dev, buf[i]);
+    }
+    k_mutex_unlock(&tx_mutex);
+}
+
+// hal_read_line: blocca finché arriva una riga da msgq
+int hal_read_line(char *buf, size_t max_len)
+{
+    if (!buf || max_len == 0) {
+        return -1;
+    }
+
+    char local_buf[LINE_BUF_SIZE];
+
+    /* Lettura bloccante dalla message queue
+       Blocca indefinitamente (K_FOREVER) finché l'ISR non mette una riga nella coda
+       Copia il messaggio dalla coda in local_buf.
+    */
+    if (k_msgq_get(&uart_msgq, &local_buf, K_FOREVER) != 0) {
+        return -1;
+    }
+
+    size_t len = strlen(local_buf); //lunghezza della riga ricevuta (senza '\0')
+    if (len >= max_len) {
+        len = max_len - 1;      // Protezione overflow: se troppo lunga per buf, tronca a max_len-1
+    }
+    memcpy(buf, local_buf, len);    // copia i caratteri nel buffer chiamante
+    buf[len] = '\0';        // termina con null terminator
+
+    return (int)len;    // Restituisce quanti byte ha copiato realmente nel buffer chiamante
+}
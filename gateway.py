@@ -1,16 +1,23 @@
 #!/usr/bin/env python3
 import argparse
 import binascii
+import collections
 import json
+import math
 import os
+import re
 import socket
+import struct
 import sys
 import threading
 import time
 import subprocess
 import tempfile
+from fractions import Fraction
 from pathlib import Path
 
+from metrics import Registry, RequestTrace, serve_metrics
+
 try:
     import serial  # pyserial
 except ImportError:
@@ -22,6 +29,7 @@ except ImportError:
 DEVICE_ENDPOINTS = {
     "nucleo": "COM3",                # UART on Windows
     "disco":  "tcp:localhost:3456",  # TCP socket (Renode bridge)
+    "native": "tcp:localhost:3457",  # agent POSIX (firmware/agent/posix) sull'host
 }
 
 
@@ -34,6 +42,318 @@ CLANG_TARGET = "wasm32-unknown-unknown"
 # wamrc di WAMR in PATH (per generare .aot)
 WAMRC_BIN = "wamrc"
 
+# Target wamrc: default Cortex-M4 delle board STM32; l'agent POSIX gira sulla CPU dell'host
+AOT_TARGET_DEFAULT = ["--target=thumbv7em", "--cpu=cortex-m4", "--target-abi=gnu"]
+AOT_TARGETS = {
+    "native": ["--target=x86_64"],
+}
+
+# Profili di build (build_and_deploy profile=..., confronto con bench.py --profiles):
+# flag di clang per C -> wasm e opzioni di wamrc per wasm -> AOT
+#   speed         come il build di sempre: -O3, wamrc --opt-level=3
+#   size          -Oz senza sezione dei nomi, wamrc --opt-level=1 e code model small
+#                 (--size-level=1; il default di wamrc è 3, code model large)
+#   trusted-fast  -O3 e AOT senza bounds check sulla memoria lineare né controlli sullo stack:
+#                 solo per moduli fidati, sul Cortex-M4 (niente MMU) un accesso fuori dalla
+#                 memoria del modulo scrive nella RAM dell'agent invece di dare un'eccezione
+BUILD_PROFILES = {
+    "speed": {
+        "clang": ["-O3"],
+        "wamrc": ["--opt-level=3"],
+    },
+    "size": {
+        "clang": ["-Oz", "-Wl,--strip-all"],
+        "wamrc": ["--opt-level=1", "--size-level=1"],
+    },
+    "trusted-fast": {
+        "clang": ["-O3"],
+        "wamrc": ["--opt-level=3", "--bounds-checks=0", "--stack-bounds-checks=0",
+                  "--disable-aux-stack-check"],
+    },
+}
+BUILD_PROFILE_DEFAULT = "speed"
+
+
+# Promozione automatica wasm -> AOT (deploy con auto_promote / build_and_deploy mode=auto):
+# quando una funzione del modulo interpretato diventa "calda" il gateway compila l'AOT
+# in background e lo ricarica sul device con lo stesso module_id (hot swap dell'agent).
+# Soglie per funzione, 0 = criterio disabilitato (sovrascrivibili da riga di comando)
+PROMOTE_AFTER_CALLS = 50
+PROMOTE_AFTER_CYCLES = 1_000_000_000   # ~5.5 s di CPU a 180 MHz (STM32F446)
+# cycles nei RESULT viene da k_cycle_get_32, che a 180 MHz torna a zero ogni ~23.8 s:
+# per i job più lunghi i cicli si ricavano da exec_us
+PROMOTE_CPU_MHZ = 180
+CYCLES_WRAP_US = (1 << 32) // PROMOTE_CPU_MHZ
+
+
+# Apertura del transport: retry per porta seriale occupata / bridge Renode non ancora pronto
+CONNECT_RETRIES = 2
+CONNECT_RETRY_DELAY = 0.2
+
+
+# Placement con device=auto: stato per device più vecchio di così viene riletto con STATUS
+# prima di scegliere; un device che non risponde resta escluso per DEVICE_DOWN_S secondi
+STATE_MAX_AGE_S = 2.0
+DEVICE_DOWN_S = 10.0
+
+# cmd=status risponde dallo stato tenuto dal gateway se è più recente di così (max_age_ms nella
+# richiesta per sovrascriverlo, 0 = chiedi sempre al device); le STATUS concorrenti verso lo
+# stesso device diventano una sola transazione sulla UART
+STATUS_MAX_AGE_S = 1.0
+
+
+# Canale eventi (cmd=subscribe) e store dei job: eventi in attesa per un subscriber lento
+# (oltre si scartano, con un evento "dropped") e job ricordati dal gateway (i più vecchi escono)
+EVENT_QUEUE_LEN = 1000
+JOB_STORE_LEN = 1000
+
+
+# Metriche (esposte in formato Prometheus da --metrics-port)
+
+METRICS = Registry()
+REQUESTS_TOTAL = METRICS.counter(
+    "gateway_requests_total", "Richieste gestite dal gateway",
+    ("device", "cmd", "module", "outcome"))
+REQUEST_DURATION = METRICS.histogram(
+    "gateway_request_duration_seconds", "Durata complessiva delle richieste",
+    ("device", "cmd", "module"))
+STAGE_DURATION = METRICS.histogram(
+    "gateway_stage_duration_seconds", "Durata dei singoli stadi di una richiesta",
+    ("device", "cmd", "stage"))
+TIMEOUTS_TOTAL = METRICS.counter(
+    "gateway_timeouts_total", "Attese verso il device terminate in timeout",
+    ("device", "cmd", "stage"))
+RETRIES_TOTAL = METRICS.counter(
+    "gateway_retries_total", "Tentativi ripetuti di apertura del transport",
+    ("device", "cmd"))
+QUEUE_DEPTH = METRICS.gauge(
+    "gateway_device_queue_depth", "Richieste in attesa o in corso sul link del device",
+    ("device",))
+PROMOTIONS_TOTAL = METRICS.counter(
+    "gateway_promotions_total", "Promozioni automatiche wasm -> AOT",
+    ("device", "module", "outcome"))
+PLACEMENTS_TOTAL = METRICS.counter(
+    "gateway_placements_total", "Richieste device=auto instradate dal gateway",
+    ("device", "cmd", "placement"))
+EVENTS_TOTAL = METRICS.counter(
+    "gateway_events_total", "Eventi pubblicati sul canale subscribe",
+    ("device", "event"))
+SUBSCRIBERS = METRICS.gauge(
+    "gateway_subscribers", "Connessioni subscribe aperte", ())
+STATUS_ANSWERS_TOTAL = METRICS.counter(
+    "gateway_status_answers_total", "Risposte a cmd=status per origine (cache, device, coalesced)",
+    ("device", "source"))
+REJECTED_CALLS_TOTAL = METRICS.counter(
+    "gateway_rejected_calls_total", "START/SCHEDULE rifiutati dal gateway (firma della funzione)",
+    ("device", "cmd"))
+
+# Un solo client alla volta per link fisico (UART o bridge Renode)
+_device_locks = {}
+_device_locks_guard = threading.Lock()
+
+
+def device_lock(device_port: str) -> threading.Lock:
+    with _device_locks_guard:
+        return _device_locks.setdefault(device_port, threading.Lock())
+
+
+# Stato dei device visto dal gateway (placement con device=auto e cmd=status dalla cache)
+# Si aggiorna da ciò che passa sul link: HELLO (device vuoto dopo un reset), LOAD_OK (modulo
+# residente), START_OK (job in esecuzione o in coda nella sua classe, attesa stimata
+# dall'agent), RESULT con job_id (fine del job in esecuzione della classe, oppure di uno in
+# coda con queued=1), STATUS_OK (runner, code per classe), più la coda delle richieste sul
+# link e la latenza recente. Dopo uno STOP o un NO_MODULE lo stato è considerato vecchio e
+# viene riletto con STATUS.
+
+PRIO_CLASSES = ("high", "normal", "low")   # come AGENT_PRIO_CLASSES del firmware (busy=HNL)
+
+
+class DeviceState:
+    def __init__(self, name: str):
+        self.name = name
+        self.module_id = None         # modulo attivo sul device (None = nessuno / sconosciuto)
+        self.tier = None
+        self.version = None
+        self.busy = [False] * len(PRIO_CLASSES)    # runner della classe con un job in corso
+        self.waiting = [0] * len(PRIO_CLASSES)     # job in coda per classe
+        self.expected_wait_ms = 0     # ultima stima dell'agent in START_OK
+        self.link_pending = 0         # richieste del gateway in attesa o in corso sul link
+        self.latency_ms = None        # media mobile della durata delle richieste brevi
+        self.updated = 0.0            # ultimo aggiornamento da STATUS/START_OK/RESULT/LOAD_OK
+        self.synced = 0.0             # ultimo STATUS_OK o HELLO (stato completo dal device)
+        self.down_until = 0.0         # escluso dal placement fino a questo istante
+        self.seen = False             # almeno uno STATUS/LOAD_OK ricevuto dal device
+
+    @property
+    def runner_busy(self) -> bool:
+        return any(self.busy)
+
+    @property
+    def queued(self) -> int:
+        return sum(self.waiting)
+
+    # Riga STATUS_OK equivalente a quella dell'agent (senza retiring/schedules, non tracciati)
+    def status_line(self) -> str:
+        runner = "RUNNING" if self.runner_busy else "IDLE"
+        if self.module_id is None:
+            return f'STATUS_OK modules="none" runner={runner}'
+        line = (f'STATUS_OK modules="wasm_module(loaded)" module_id={self.module_id} '
+                f'runner={runner} tier={self.tier} version={self.version}')
+        if self.runner_busy or self.queued:
+            flags = "".join(c[0].upper() for c, b in zip(PRIO_CLASSES, self.busy) if b) or "-"
+            line += f" busy={flags} queued={','.join(str(q) for q in self.waiting)}"
+        return line
+
+    def load(self):
+        # lavoro davanti a un nuovo job, poi attesa stimata e latenza recente
+        work = self.link_pending + (1 if self.runner_busy else 0) + self.queued
+        return (work, self.expected_wait_ms, self.latency_ms or 0.0)
+
+    def snapshot(self) -> dict:
+        now = time.time()
+        return {
+            "module_id": self.module_id,
+            "tier": self.tier,
+            "version": self.version,
+            "runner": "RUNNING" if self.runner_busy else "IDLE",
+            "queued": self.queued,
+            "expected_wait_ms": self.expected_wait_ms,
+            "link_pending": self.link_pending,
+            "latency_ms": round(self.latency_ms, 2) if self.latency_ms is not None else None,
+            "age_s": round(now - self.updated, 2) if self.updated else None,
+            "down": now < self.down_until,
+        }
+
+
+_states = {}   # nome device -> DeviceState
+_states_guard = threading.Lock()
+
+
+def device_state(device: str) -> DeviceState:
+    with _states_guard:
+        st = _states.get(device)
+        if st is None:
+            st = _states[device] = DeviceState(device)
+        return st
+
+
+def note_link(device: str, delta: int):
+    st = device_state(device)
+    with _states_guard:
+        st.link_pending += delta
+
+
+def note_loaded(device: str, module_id: str, load_ok_line: str):
+    kv = parse_kv_line(load_ok_line)
+    st = device_state(device)
+    with _states_guard:
+        st.module_id = module_id
+        st.tier = kv.get("tier")
+        st.version = kv.get("version")
+        st.updated = time.time()
+        st.down_until = 0.0
+        st.seen = True
+    forget_sigs(device)
+
+
+def note_status(device: str, status_line: str):
+    kv = parse_kv_line(status_line)
+    st = device_state(device)
+    with _states_guard:
+        if kv.get("modules") == '"none"':
+            st.module_id = st.tier = st.version = None
+        else:
+            st.module_id = str(kv["module_id"]) if "module_id" in kv else st.module_id
+            st.tier = kv.get("tier")
+            st.version = kv.get("version")
+        flags = str(kv.get("busy", "N" if kv.get("runner") == "RUNNING" else ""))
+        st.busy = [c[0].upper() in flags for c in PRIO_CLASSES]
+        queued = [int(q) for q in str(kv.get("queued", "")).split(",") if q.isdigit()]
+        st.waiting = queued if len(queued) == len(PRIO_CLASSES) else [0, sum(queued), 0]
+        if not st.runner_busy:
+            st.expected_wait_ms = 0
+        st.updated = st.synced = time.time()
+        st.down_until = 0.0
+        st.seen = True
+
+
+def prio_index(kv: dict) -> int:
+    prio = kv.get("prio", "normal")
+    return PRIO_CLASSES.index(prio) if prio in PRIO_CLASSES else 1
+
+
+# START_OK: il job parte subito se il runner della classe è libero, altrimenti va in coda
+def note_started(device: str, kv: dict):
+    st = device_state(device)
+    c = prio_index(kv)
+    with _states_guard:
+        if st.busy[c]:
+            st.waiting[c] += 1
+        else:
+            st.busy[c] = True
+        st.expected_wait_ms = int(kv.get("expected_wait_ms", 0) or 0)
+        st.updated = time.time()
+
+
+# RESULT di un job: tolto dalla coda (queued=1, STOP) oppure finito sul runner della classe,
+# che passa al job successivo in coda se c'è
+def note_finished(device: str, kv: dict):
+    st = device_state(device)
+    c = prio_index(kv)
+    with _states_guard:
+        if not st.updated:
+            return   # stato già da rileggere: il placement e status chiedono STATUS
+        if kv.get("queued") == 1:
+            st.waiting[c] = max(st.waiting[c] - 1, 0)
+        elif not st.busy[c]:
+            # job che il gateway non ha visto partire: si rilegge STATUS
+            st.updated = st.synced = 0.0
+            return
+        elif st.waiting[c]:
+            st.waiting[c] -= 1
+        else:
+            st.busy[c] = False
+        if not st.runner_busy:
+            st.expected_wait_ms = 0
+        st.updated = time.time()
+
+
+# HELLO: il device è appena partito, senza moduli né job
+def note_hello(device: str):
+    st = device_state(device)
+    with _states_guard:
+        st.module_id = st.tier = st.version = None
+        st.busy = [False] * len(PRIO_CLASSES)
+        st.waiting = [0] * len(PRIO_CLASSES)
+        st.expected_wait_ms = 0
+        st.updated = st.synced = time.time()
+        st.down_until = 0.0
+        st.seen = True
+    forget_sigs(device)
+
+
+def note_stale(device: str, module_missing: bool = False):
+    st = device_state(device)
+    with _states_guard:
+        st.updated = st.synced = 0.0
+        if module_missing:
+            st.module_id = None
+    if module_missing:
+        forget_sigs(device)
+
+
+def note_latency(device: str, seconds: float):
+    st = device_state(device)
+    with _states_guard:
+        ms = seconds * 1000.0
+        st.latency_ms = ms if st.latency_ms is None else 0.8 * st.latency_ms + 0.2 * ms
+
+
+def note_down(device: str):
+    st = device_state(device)
+    with _states_guard:
+        st.down_until = time.time() + DEVICE_DOWN_S
+
 
 # Transport 
 
@@ -41,6 +361,8 @@ class Transport:
     def __init__(self, ser=None, sock=None):
         self.ser = ser
         self.sock = sock
+        self.closed = False    # il peer ha chiuso la connessione
+        self.rx = bytearray()  # riga parziale: resta per la read_line successiva (link persistente)
 
     def close(self):
         if self.ser is not None:
@@ -76,7 +398,8 @@ class Transport:
 
     def read_line(self, timeout: float = 1.0):
         deadline = time.time() + timeout
-        buf = bytearray()
+        buf = self.rx
+        complete = False
         while time.time() < deadline:
             b = None
             try:
@@ -92,6 +415,7 @@ class Transport:
                     self.sock.settimeout(0.1)   
                     chunk = self.sock.recv(1)   
                     if not chunk:
+                        self.closed = True
                         # Il peer ha chiuso la connessione. Se non abbiamo ancora nessun byte in buf, consideriamo che non sia arrivata nessuna riga.
                         if not buf:
                             return None
@@ -105,10 +429,13 @@ class Transport:
             buf += b
             if b == b"\n":
                 # Newline ricevuto: fine della riga
+                complete = True
                 break
 
-        if not buf:
+        if not buf or not (complete or self.closed):
+            # timeout a metà riga: i byte restano in self.rx
             return None
+        self.rx = bytearray()
         
         # Decodifica la riga come ASCII, ignorando eventuali caratteri non validi e rimuove \r\n finali
         line = buf.decode("ascii", errors="ignore").rstrip("\r\n")
@@ -135,6 +462,304 @@ def open_transport(port: str) -> Transport:
         return Transport(ser=ser)
 
 
+# Link persistente verso il device
+# Il transport resta aperto tra una richiesta e l'altra e un thread lettore consuma ogni riga
+# del device: le righe arrivate mentre una richiesta tiene il link vanno anche alla richiesta
+# (LinkSession.read_line), e tutte passano da publish_line (eventi e store dei job). Così i
+# RESULT dei job lanciati senza attesa, gli HELLO dopo un reset e gli SRESULT di mode=stream
+# non vanno persi quando nessuna richiesta è in corso.
+
+class DeviceLink:
+    def __init__(self, device: str, port: str):
+        self.device = device
+        self.port = port
+        self.transport = None
+        self.open_lock = threading.Lock()
+        self.cond = threading.Condition()
+        self.lines = collections.deque()   # righe per la richiesta che tiene il link
+        self.session = False
+        self.context = {}                  # module_id/func dell'ultimo START (per job_started)
+
+    def ensure_open(self):
+        with self.open_lock:
+            if self.transport is not None:
+                return
+            t = open_transport(self.port)
+            t.flush_input()
+            self.transport = t
+        print(f"[link] {self.device}: aperto {self.port}")
+        threading.Thread(target=self.reader, args=(t,), daemon=True).start()
+
+    def drop(self, t: Transport):
+        with self.open_lock:
+            if self.transport is t:
+                self.transport = None
+        try:
+            t.close()
+        except OSError:
+            pass
+
+    def reader(self, t: Transport):
+        try:
+            while not t.closed and self.transport is t:
+                line = t.read_line(timeout=1.0)
+                if line is None:
+                    continue
+                # prima lo stato del device e lo store dei job, poi la richiesta che tiene il
+                # link: chi riceve START_OK/RESULT trova già il gateway aggiornato
+                with self.cond:
+                    context = self.context
+                publish_line(self.device, self.port, line, context)
+                with self.cond:
+                    if self.session:
+                        self.lines.append(line)
+                        self.cond.notify_all()
+        except (OSError, ValueError) as e:
+            print(f"[link] {self.device}: errore in lettura: {e}")
+        if self.transport is t:
+            publish({"event": "device_down", "device": self.device})
+            note_down(self.device)
+        self.drop(t)
+
+
+_links = {}   # porta -> DeviceLink
+_links_guard = threading.Lock()
+
+
+def device_link(device: str, device_port: str) -> DeviceLink:
+    with _links_guard:
+        link = _links.get(device_port)
+        if link is None:
+            link = _links[device_port] = DeviceLink(device, device_port)
+        return link
+
+
+# Vista di una richiesta sul link: stessa interfaccia di Transport usata dalle gw_*
+class LinkSession:
+    def __init__(self, link: DeviceLink, release):
+        self.link = link
+        self.release = release
+
+    def annotate(self, **context):
+        with self.link.cond:
+            self.link.context = context
+
+    def flush_input(self):
+        with self.link.cond:
+            self.link.lines.clear()
+
+    def write_line(self, text: str):
+        self.write((text + "\n").encode("ascii"))
+
+    def write(self, data: bytes):
+        t = self.link.transport
+        if t is None:
+            raise OSError("link verso il device chiuso")
+        try:
+            t.write(data)
+        except OSError:
+            self.link.drop(t)
+            raise
+
+    def read_line(self, timeout: float = 1.0):
+        deadline = time.time() + timeout
+        with self.link.cond:
+            while not self.link.lines:
+                left = deadline - time.time()
+                if left <= 0:
+                    return None
+                self.link.cond.wait(left)
+            return self.link.lines.popleft()
+
+    def close(self):
+        with self.link.cond:
+            self.link.session = False
+            self.link.lines.clear()
+        self.release()
+
+
+# Serializza gli accessi al link del device: attende il proprio turno (stadio queue_wait),
+# apre il link se non è già aperto, con retry (stadio connect), e lo prende per la richiesta
+
+def connect_device(device_port: str, trace: RequestTrace) -> LinkSession:
+    lock = device_lock(device_port)
+    QUEUE_DEPTH.inc(device=trace.device)
+    note_link(trace.device, 1)
+    with trace.stage("queue_wait"):
+        lock.acquire()
+
+    def release():
+        lock.release()
+        QUEUE_DEPTH.dec(device=trace.device)
+        note_link(trace.device, -1)
+
+    link = device_link(trace.device, device_port)
+    try:
+        with trace.stage("connect"):
+            attempt = 0
+            while True:
+                try:
+                    link.ensure_open()
+                    break
+                except (OSError, RuntimeError) as e:
+                    # serial.SerialException deriva da IOError/OSError
+                    if attempt >= CONNECT_RETRIES or isinstance(e, RuntimeError):
+                        raise
+                    attempt += 1
+                    trace.retries += 1
+                    time.sleep(CONNECT_RETRY_DELAY)
+    except BaseException:
+        release()
+        raise
+
+    with link.cond:
+        link.session = True
+    t = LinkSession(link, release)
+    with trace.stage("flush"):
+        t.flush_input()
+    return t
+
+
+# Eventi verso i subscriber (cmd=subscribe), una riga JSON per evento:
+#   job_started  START_OK (device, job_id, module_id, func, prio, ...)
+#   result       RESULT di un job (status=OK/EXCEPTION/EXPIRED/..., ret_i32, cycles, ...)
+#   stopped      RESULT status=STOPPED (STOP o job tolto dalla coda)
+#   sched_result SRESULT di uno SCHEDULE con mode=stream
+#   device_hello HELLO del device (boot o reset: moduli e job persi)
+#   device_down  link verso il device chiuso
+
+class Subscriber:
+    def __init__(self, devices, events):
+        self.devices = set(devices) if devices else None   # None = tutti
+        self.events = set(events) if events else None
+        self.queue = collections.deque()
+        self.cond = threading.Condition()
+        self.dropped = 0
+        self.closed = False
+
+    def wants(self, ev: dict) -> bool:
+        if self.events is not None and ev["event"] not in self.events:
+            return False
+        return self.devices is None or ev.get("device") in self.devices or "device" not in ev
+
+    def push(self, ev: dict):
+        with self.cond:
+            if len(self.queue) >= EVENT_QUEUE_LEN:
+                self.dropped += 1
+                return
+            self.queue.append(ev)
+            self.cond.notify()
+
+    def pop(self, timeout: float):
+        with self.cond:
+            if not self.queue and not self.closed:
+                self.cond.wait(timeout)
+            if self.dropped:
+                dropped, self.dropped = self.dropped, 0
+                return {"event": "dropped", "count": dropped}
+            return self.queue.popleft() if self.queue else None
+
+    def close(self):
+        with self.cond:
+            self.closed = True
+            self.cond.notify()
+
+
+_subscribers = []
+_subscribers_guard = threading.Lock()
+
+
+def publish(ev: dict):
+    ev.setdefault("ts", round(time.time(), 3))
+    EVENTS_TOTAL.inc(device=ev.get("device", ""), event=ev["event"])
+    with _subscribers_guard:
+        subs = list(_subscribers)
+    for sub in subs:
+        if sub.wants(ev):
+            sub.push(ev)
+
+
+# Classifica una riga del device (thread lettore del link)
+def publish_line(device: str, device_port: str, line: str, context: dict):
+    kind = line.split(" ", 1)[0]
+    kv = parse_kv_line(line)
+    if kind == "HELLO":
+        note_hello(device)
+        jobs_lost(device)
+        publish({"event": "device_hello", "device": device, **kv})
+    elif kind == "START_OK" and "job_id" in kv:
+        note_started(device, kv)
+        job = job_started(device, kv, context)
+        publish({"event": "job_started", **job})
+    elif kind == "RESULT" and "job_id" in kv:
+        # i RESULT senza job_id sono risposte immediate a START (BUSY, NO_FUNC, ...)
+        note_finished(device, kv)
+        job = job_finished(device, kv, line)
+        if "cycles" in kv:
+            # la funzione è stata eseguita: conta per la promozione anche i job lanciati senza
+            # attendere il RESULT, che arriva solo qui
+            note_call(device_port, job.get("module_id"), job.get("func"), kv)
+        publish({"event": "stopped" if kv.get("status") == "STOPPED" else "result", **job})
+    elif kind == "SRESULT":
+        publish({"event": "sched_result", "device": device, **kv, **parse_call_results(kv)})
+
+
+# Store dei job: ultimo stato di ogni job visto sul link, per device e job_id
+# (FETCH dei risultati dal gateway con cmd=job, anche dopo la fine della richiesta)
+
+_jobs = collections.OrderedDict()   # (device, job_id) -> dict
+_jobs_guard = threading.Lock()
+
+
+def _job_entry(device: str, job_id: int) -> dict:
+    key = (device, job_id)
+    job = _jobs.get(key)
+    if job is None:
+        job = _jobs[key] = {"device": device, "job_id": job_id, "state": "pending"}
+        while len(_jobs) > JOB_STORE_LEN:
+            _jobs.popitem(last=False)
+    return job
+
+
+def job_started(device: str, kv: dict, context: dict) -> dict:
+    with _jobs_guard:
+        # dopo un reset il device riparte da job_id=1: l'entry vecchia viene sostituita
+        _jobs.pop((device, kv["job_id"]), None)
+        job = _job_entry(device, kv["job_id"])
+        job.update(module_id=context.get("module_id"), func=context.get("func"),
+                   prio=kv.get("prio"), ahead=kv.get("ahead"),
+                   expected_wait_ms=kv.get("expected_wait_ms"), started_at=round(time.time(), 3))
+        return dict(job)
+
+
+def job_finished(device: str, kv: dict, line: str) -> dict:
+    with _jobs_guard:
+        job = _job_entry(device, kv["job_id"])
+        _jobs.move_to_end((device, kv["job_id"]))
+        status = kv.get("status")
+        job.update(state="done" if status == "OK" else str(status).lower(), status=status,
+                   func=job.get("func") or kv.get("func"), detail=line,
+                   finished_at=round(time.time(), 3))
+        for key in ("ret_i32", "tier", "version", "cycles", "exec_us"):
+            if key in kv:
+                job[key] = kv[key]
+        job.update(parse_call_results(kv))
+        return dict(job)
+
+
+def jobs_lost(device: str):
+    with _jobs_guard:
+        for job in _jobs.values():
+            if job["device"] == device and job["state"] == "pending":
+                job["state"] = "lost"
+
+
+def get_job(device: str, job_id: int):
+    with _jobs_guard:
+        job = _jobs.get((device, job_id))
+        return dict(job) if job is not None else None
+
+
 def read_until_prefix(transport: Transport, prefixes, timeout: float):
     deadline = time.time() + timeout
     while time.time() < deadline:
@@ -152,11 +777,11 @@ def read_until_prefix(transport: Transport, prefixes, timeout: float):
 
 # Compila un file C in un modulo .wasm
 
-def compile_to_wasm(source_c: str, out_wasm: str):
+def compile_to_wasm(source_c: str, out_wasm: str, profile: str = BUILD_PROFILE_DEFAULT):
     cmd = [
         CLANG_BIN,
         f"--target={CLANG_TARGET}",
-        "-O3",
+        *BUILD_PROFILES[profile]["clang"],
         "-nostdlib",
         "-Wl,--no-entry",
         "-Wl,--initial-memory=65536",
@@ -181,12 +806,12 @@ def compile_to_wasm(source_c: str, out_wasm: str):
 
 # Compila un modulo .wasm in .aot
 
-def compile_to_aot(wasm_path: str, out_aot: str):
+def compile_to_aot(wasm_path: str, out_aot: str, target_args=None,
+                   profile: str = BUILD_PROFILE_DEFAULT):
     cmd = [
         WAMRC_BIN,
-        "--target=thumbv7em",
-        "--cpu=cortex-m4",
-        "--target-abi=gnu",
+        *(target_args or AOT_TARGET_DEFAULT),
+        *BUILD_PROFILES[profile]["wamrc"],
         "-o", out_aot,
         wasm_path,
     ]
@@ -204,48 +829,250 @@ def compile_to_aot(wasm_path: str, out_aot: str):
 
 # Operazioni verso l'agent 
 
-def gw_deploy(device_port: str, module_id: str, wasm_or_aot_path: str):
-    if not os.path.isfile(wasm_or_aot_path):
-        return {"ok": False, "error": f"file non trovato: {wasm_or_aot_path}"}
-
-    with open(wasm_or_aot_path, "rb") as f:
-        data = f.read()
+# LOAD + payload binario su un transport già aperto (usato da deploy e dalla promozione ad AOT)
 
+def load_module(t: Transport, module_id: str, data: bytes, trace: RequestTrace):
     size = len(data)   # numero di byte del modulo
     crc32 = binascii.crc32(data) & 0xFFFFFFFF  # checksum calcolato sui dati
     crc_hex = f"{crc32:08x}"   #  rappresentazione esadecimale a 8 cifre, da mettere nella riga LOAD
 
-    t = open_transport(device_port)
-    try:
-        t.flush_input()
-        line = f"LOAD module_id={module_id} size={size} crc32={crc_hex}"
-        print(">>", line)
+    line = f"LOAD module_id={module_id} size={size} crc32={crc_hex}"
+    print(">>", line)
+    with trace.stage("send"):
         t.write_line(line)
 
+    with trace.stage("wait_load_ready"):
         resp = read_until_prefix(t, ["LOAD_READY", "LOAD_ERR"], timeout=3.0)
-        if resp is None:
-            return {"ok": False, "error": "timeout in attesa di LOAD_READY/LOAD_ERR"}
-        if resp.startswith("LOAD_ERR"):
-            return {"ok": False, "error": resp}
-
-        print(f">> [BINARY] {size} bytes")
+    if resp is None:
+        trace.timeout("wait_load_ready")
+        return {"ok": False, "error": "timeout in attesa di LOAD_READY/LOAD_ERR"}
+    if resp.startswith("LOAD_ERR"):
+        return {"ok": False, "error": resp}
+
+    print(f">> [BINARY] {size} bytes")
+    with trace.stage("binary_transfer"):
         t.write(data)
 
+    with trace.stage("wait_load_ok"):
         resp2 = read_until_prefix(t, ["LOAD_OK", "LOAD_ERR"], timeout=3.0)
-        if resp2 is None:
-            return {"ok": False, "error": "timeout in attesa di LOAD_OK/LOAD_ERR"}
-        if resp2.startswith("LOAD_ERR"):
-            return {"ok": False, "error": resp2}
-        return {"ok": True, "detail": resp2}
+    if resp2 is None:
+        trace.timeout("wait_load_ok")
+        return {"ok": False, "error": "timeout in attesa di LOAD_OK/LOAD_ERR"}
+    if resp2.startswith("LOAD_ERR"):
+        return {"ok": False, "error": resp2}
+    return {"ok": True, "detail": resp2}
+
+
+def gw_deploy(device_port: str, module_id: str, wasm_or_aot_path: str,
+              trace: RequestTrace, auto_promote: bool = False, aot_target=None,
+              profile: str = BUILD_PROFILE_DEFAULT):
+    if not os.path.isfile(wasm_or_aot_path):
+        return {"ok": False, "error": f"file non trovato: {wasm_or_aot_path}"}
+    if profile not in BUILD_PROFILES:
+        return {"ok": False,
+                "error": f"profilo sconosciuto: {profile} (validi: {', '.join(BUILD_PROFILES)})"}
+
+    with open(wasm_or_aot_path, "rb") as f:
+        data = f.read()
+
+    remember_image(module_id, data, aot_target, auto_promote, profile)
+    return deploy_image(device_port, module_id, data, trace, auto_promote, aot_target, profile)
+
+
+# LOAD di un modulo già in memoria (deploy da file e deploy su richiesta del placement)
+
+def deploy_image(device_port: str, module_id: str, data: bytes, trace: RequestTrace,
+                 auto_promote: bool = False, aot_target=None,
+                 profile: str = BUILD_PROFILE_DEFAULT):
+    t = connect_device(device_port, trace)
+    try:
+        # il device ha un solo slot: qualunque deploy sostituisce il modulo da promuovere
+        forget_promotion(device_port)
+        res = load_module(t, module_id, data, trace)
     finally:
         t.close()
 
+    if res.get("ok"):
+        note_loaded(trace.device, module_id, res["detail"])
+
+    if res.get("ok") and auto_promote:
+        if "tier=aot" in res["detail"]:
+            res["promotion"] = "already_aot"
+        else:
+            register_promotion(trace.device, device_port, module_id, data, aot_target, profile)
+            res["promotion"] = "armed"
+    return res
+
+
+# Firme delle funzioni esportate (SIGS)
+#
+# L'agent legge da WAMR parametri e risultati di ogni export e li elenca con SIGS, una riga
+# "SIG func=<nome> params=i32,f64 results=i64" per funzione (- = nessuno, * = tipo non
+# supportato). Il gateway tiene la tabella per device finché il modulo non cambia (LOAD_OK,
+# HELLO, NO_MODULE) e controlla gli argomenti di START e SCHEDULE prima di scriverli sul
+# link: una chiamata sbagliata non occupa la UART né la coda dell'agent.
+
+WASM_INT_RANGE = {
+    "i32": (-(1 << 31), (1 << 32) - 1),    # come l'agent: anche u32 scritti in positivo
+    "i64": (-(1 << 63), (1 << 64) - 1),
+}
+MIN_NORMAL = {"f32": 2.0 ** -126, "f64": 2.0 ** -1022}
+
+# Sintassi accettata da strtoll/strtoull in base 0 e da strtof/strtod (parse_typed_value dell'agent)
+C_INT_SYNTAX = re.compile(r"[+-]?(0[xX][0-9a-fA-F]+|0[0-7]*|[1-9][0-9]*)")
+C_FLOAT_SYNTAX = re.compile(
+    r"[+-]?(?:0[xX](?P<hex>[0-9a-fA-F]+\.?[0-9a-fA-F]*|\.[0-9a-fA-F]+)(?:[pP](?P<exp2>[+-]?[0-9]+))?"
+    r"|(?P<dec>[0-9]+\.?[0-9]*|\.[0-9]+)(?:[eE][+-]?[0-9]+)?"
+    r"|(?P<special>inf|infinity|nan(?:\([0-9A-Za-z_]*\))?))", re.IGNORECASE)
+
+_sigs = {}   # nome device -> {"module_id", "version", "funcs": {nome: (params, results)} | None}
+_sigs_guard = threading.Lock()
+
+
+def forget_sigs(device: str):
+    with _sigs_guard:
+        _sigs.pop(device, None)
+
+
+def parse_types(text) -> list:
+    text = str(text)
+    return [] if text == "-" else text.split(",")
+
+
+# Legge le firme sul link già preso dalla richiesta; None se il device non le fornisce
+def device_sigs(t: LinkSession, trace: RequestTrace):
+    with _sigs_guard:
+        if trace.device in _sigs:
+            return _sigs[trace.device]
+
+    print(">> SIGS")
+    with trace.stage("send"):
+        t.write_line("SIGS")
+    funcs = {}
+    with trace.stage("wait_sigs"):
+        while True:
+            resp = read_until_prefix(t, ["SIG ", "SIGS_OK", "SIGS_ERR", "ERROR"], timeout=3.0)
+            if resp is None or not resp.startswith("SIG "):
+                break
+            kv = parse_kv_line(resp)
+            funcs[str(kv.get("func"))] = (parse_types(kv.get("params", "-")),
+                                          parse_types(kv.get("results", "-")))
+    if resp is None:
+        trace.timeout("wait_sigs")
+        return None
+    if resp.startswith("ERROR") and "UNKNOWN_COMMAND" in resp:
+        # firmware senza SIGS: nessun controllo lato gateway, decide l'agent
+        entry = {"module_id": None, "version": None, "funcs": None}
+    elif resp.startswith("SIGS_OK"):
+        kv = parse_kv_line(resp)
+        entry = {"module_id": str(kv.get("module_id")), "version": kv.get("version"),
+                 "funcs": funcs}
+    else:
+        return None   # NO_MODULE o modulo in staging: risponde l'agent a START/SCHEDULE
+    with _sigs_guard:
+        _sigs[trace.device] = entry
+    return entry
+
+
+# Converte un argomento come parse_typed_value dell'agent: interi con strtoll/strtoull in base 0
+# (0x.. esadecimale, 0.. ottale, niente _ né 0b/0o), float con strtof/strtod (anche 0x1.8p3,
+# inf, nan), ERANGE compreso: overflow e underflow inesatto. ValueError se il testo non è un
+# valore del tipo, OverflowError se è fuori range. Unica differenza: gli spazi iniziali, che
+# strto* salterebbe, qui sono un errore come quelli finali
+def parse_wasm_value(text: str, kind: str):
+    if kind in WASM_INT_RANGE:
+        if not C_INT_SYNTAX.fullmatch(text):
+            raise ValueError(text)
+        digits = text.lstrip("+-")
+        v = int(text, 16 if digits[:2] in ("0x", "0X") else 8 if digits.startswith("0") else 10)
+        lo, hi = WASM_INT_RANGE[kind]
+        if not lo <= v <= hi:
+            raise OverflowError(text)
+        return v
+
+    m = C_FLOAT_SYNTAX.fullmatch(text)
+    if not m:
+        raise ValueError(text)
+    if m["special"]:
+        return float(text.split("(")[0])
+    # float.fromhex segnala da sé l'overflow; struct.pack quello verso f32
+    v = float.fromhex(text) if m["hex"] else float(text)
+    if math.isinf(v):
+        raise OverflowError(text)
+    if kind == "f32":
+        v = struct.unpack("<f", struct.pack("<f", v))[0]
+    nonzero = re.search("[1-9a-fA-F]" if m["hex"] else "[1-9]", m["hex"] or m["dec"])
+    if nonzero and abs(v) < MIN_NORMAL[kind]:
+        # risultato subnormale o zero: strto* dà ERANGE solo se l'arrotondamento ha perso cifre
+        if m["hex"]:
+            mant, _, frac = m["hex"].partition(".")
+            exact = Fraction(int(mant + frac, 16), 16 ** len(frac)) * Fraction(2) ** int(m["exp2"] or 0)
+        else:
+            exact = Fraction(text)
+        if v == 0 or abs(Fraction(v)) != abs(exact):
+            raise OverflowError(text)
+    return v
+
+
+# Stesse regole di parse_call_args dell'agent; ritorna il messaggio d'errore o None
+def check_args(params: list, func_args: str):
+    values = [tok.split("=", 1)[1] for tok in (func_args or "").split(",") if "=" in tok]
+    if "*" in params:
+        return "tipo di parametro non supportato"
+    if len(values) != len(params):
+        return f"attesi {len(params)} argomenti, ricevuti {len(values)}"
+    for i, (text, kind) in enumerate(zip(values, params), start=1):
+        try:
+            parse_wasm_value(text, kind)
+        except OverflowError:
+            return f"argomento {i} fuori dal range di {kind}: {text}"
+        except ValueError:
+            return f"argomento {i} non è un {kind}: {text}"
+    return None
+
+
+def check_call(t: LinkSession, trace: RequestTrace, module_id: str, func_name: str,
+               func_args: str):
+    entry = device_sigs(t, trace)
+    if entry is None or entry["funcs"] is None or entry["module_id"] != module_id:
+        return None
+    sig = entry["funcs"].get(func_name)
+    if sig is None:
+        err = f"funzione {func_name} non esportata da {module_id} (version={entry['version']})"
+    else:
+        err = check_args(sig[0], func_args)
+        if err:
+            err = f"args non validi per {func_name}({','.join(sig[0])}): {err}"
+    if err is None:
+        return None
+    REJECTED_CALLS_TOTAL.inc(device=trace.device, cmd=trace.cmd)
+    return {"ok": False, "error": err,
+            "signature": {"params": sig[0], "results": sig[1]} if sig else None}
+
+
+# Risultati tipizzati di RESULT/SRESULT: ret_i32=<u32> per un solo i32,
+# altrimenti ret=<v0>,<v1> ret_types=<t0>,<t1>
+def parse_call_results(kv: dict) -> dict:
+    if "ret_i32" in kv:
+        v = int(kv["ret_i32"])
+        return {"results": [v - (1 << 32) if v >= 1 << 31 else v], "result_types": ["i32"]}
+    if "ret" not in kv or "ret_types" not in kv:
+        return {}
+    types = parse_types(kv["ret_types"])
+    values = []
+    for text, kind in zip(str(kv["ret"]).split(","), types):
+        values.append(int(text) if kind in WASM_INT_RANGE else float(text))
+    return {"results": values, "result_types": types}
+
 
 def gw_start(device_port: str, module_id: str, func_name: str,
-             func_args: str, wait_result: bool, result_timeout: float):
-    t = open_transport(device_port)
+             func_args: str, wait_result: bool, result_timeout: float,
+             trace: RequestTrace, prio=None, deadline_ms=None):
+    t = connect_device(device_port, trace)
     try:
-        t.flush_input()
+        err = check_call(t, trace, module_id, func_name, func_args)
+        if err:
+            return err
         if func_args:
             line = (
                 f"START module_id={module_id} "
@@ -256,14 +1083,23 @@ def gw_start(device_port: str, module_id: str, func_name: str,
                 f"START module_id={module_id} "
                 f"func={func_name}"
             )
+        # classe di priorità e deadline: l'agent accoda il job (EDF nella classe) o lo rifiuta
+        if prio:
+            line += f" prio={prio}"
+        if deadline_ms:
+            line += f" deadline_ms={int(deadline_ms)}"
         print(">>", line)
-        t.write_line(line)
+        t.annotate(module_id=module_id, func=func_name)
+        with trace.stage("send"):
+            t.write_line(line)
 
         while True:
-            resp = read_until_prefix(
-                t, ["START_OK", "RESULT", "ERROR"], timeout=3.0
-            )
+            with trace.stage("wait_start_ok"):
+                resp = read_until_prefix(
+                    t, ["START_OK", "RESULT", "ERROR"], timeout=3.0
+                )
             if resp is None:
+                trace.timeout("wait_start_ok")
                 return {"ok": False,
                         "error": "timeout in attesa di START_OK/RESULT/ERROR"}
 
@@ -271,38 +1107,61 @@ def gw_start(device_port: str, module_id: str, func_name: str,
                 return {"ok": False, "error": resp}
 
             if resp.startswith("RESULT"):
+                if "status=NO_MODULE" in resp:
+                    note_stale(trace.device, module_missing=True)
                 if ("status=NO_MODULE" in resp
                         or "status=BUSY" in resp
+                        or "status=REJECTED" in resp
+                        or "status=BAD_PARAMS" in resp
                         or "status=NO_FUNC" in resp):
                     return {"ok": False, "error": resp}
                 continue
 
             break  # START_OK
 
+        # START_OK job_id=<n> prio=<classe> ahead=<n> expected_wait_ms=<stima>
+        job_id = parse_kv_line(resp).get("job_id")
         if not wait_result:
-            return {"ok": True, "detail": "START_OK"}
+            return {"ok": True, "detail": resp}
 
-        resp2 = read_until_prefix(t, ["RESULT"], timeout=result_timeout)
+        # sul link possono arrivare i RESULT di job lanciati prima senza attesa: solo il nostro job_id
+        deadline = time.time() + result_timeout
+        resp2 = None
+        with trace.stage("wait_result"):
+            while resp2 is None and time.time() < deadline:
+                line2 = read_until_prefix(t, ["RESULT"], timeout=deadline - time.time())
+                if line2 is None:
+                    break
+                if job_id is None or parse_kv_line(line2).get("job_id") == job_id:
+                    resp2 = line2
         if resp2 is None:
+            trace.timeout("wait_result")
             return {"ok": False, "error": "timeout in attesa di RESULT"}
-        return {"ok": True, "detail": resp2}
+        return {"ok": True, "detail": resp2, "queued": resp,
+                **parse_call_results(parse_kv_line(resp2))}
     finally:
         t.close()
 
 
-def gw_stop(device_port: str, module_id: str, result_timeout: float):
-    t = open_transport(device_port)
+def gw_stop(device_port: str, module_id: str, result_timeout: float,
+            trace: RequestTrace, job_id=None):
+    t = connect_device(device_port, trace)
     try:
-        t.flush_input()
         line = f"STOP module_id={module_id}"
+        if job_id:
+            line += f" job_id={int(job_id)}"
         print(">>", line)
-        t.write_line(line)
+        with trace.stage("send"):
+            t.write_line(line)
 
-        resp = read_until_prefix(t, ["STOP_OK", "RESULT", "ERROR"], timeout=3.0)
+        with trace.stage("wait_stop_ok"):
+            resp = read_until_prefix(t, ["STOP_OK", "RESULT", "ERROR"], timeout=3.0)
         if resp is None:
+            trace.timeout("wait_stop_ok")
             return {"ok": False,
                     "error": "timeout in attesa di STOP_OK/RESULT/ERROR"}
 
+        note_stale(trace.device)
         if resp.startswith("RESULT") or resp.startswith("ERROR"):
             # l’agent può rispondere subito con un RESULT finale (funzione già terminata) o con un ERROR; in quel caso non serve altro, rimanda direttamente la risposta all’host
             return {"ok": True, "detail": resp}
@@ -310,66 +1169,691 @@ def gw_stop(device_port: str, module_id: str, result_timeout: float):
         if "status=PENDING" not in resp:
             return {"ok": True, "detail": resp}
 
-        resp2 = read_until_prefix(t, ["RESULT"], timeout=result_timeout)
+        # i job tolti dalla coda rispondono subito (queued=1): si aspetta quello in esecuzione
+        deadline = time.time() + result_timeout
+        resp2 = None
+        with trace.stage("wait_result"):
+            while resp2 is None and time.time() < deadline:
+                line2 = read_until_prefix(t, ["RESULT"], timeout=deadline - time.time())
+                if line2 is None:
+                    break
+                if "queued=1" not in line2.split():
+                    resp2 = line2
         if resp2 is None:
+            trace.timeout("wait_result")
             return {"ok": False, "error": "timeout in attesa di RESULT (stop)"}
         return {"ok": True, "detail": resp2}
     finally:
         t.close()
 
 
-def gw_status(device_port: str):
-    t = open_transport(device_port)
+# Richieste identiche concorrenti verso lo stesso device: la prima fa la transazione sul link,
+# le altre aspettano la sua risposta invece di mettersi in coda sulla UART
+
+class Flight:
+    def __init__(self):
+        self.done = threading.Event()
+        self.result = None
+
+
+_flights = {}   # (device, comando) -> Flight in corso
+_flights_guard = threading.Lock()
+
+
+def coalesce(key, fn):
+    with _flights_guard:
+        flight = _flights.get(key)
+        leader = flight is None
+        if leader:
+            flight = _flights[key] = Flight()
+    if not leader:
+        flight.done.wait()
+        if flight.result is None:
+            return {"ok": False, "error": "errore verso il device (richiesta accorpata)"}
+        return {**flight.result, "coalesced": True}
+    try:
+        flight.result = fn()
+        return flight.result
+    finally:
+        with _flights_guard:
+            _flights.pop(key, None)
+        flight.done.set()
+
+
+# status: dallo stato del gateway se l'ultimo STATUS_OK/HELLO ha al massimo max_age secondi
+# (nel frattempo START_OK/RESULT/LOAD_OK lo tengono aggiornato), altrimenti dal device
+def gw_status(device_port: str, trace: RequestTrace, max_age=None):
+    max_age = STATUS_MAX_AGE_S if max_age is None else max_age
+    st = device_state(trace.device)
+    now = time.time()
+    with _states_guard:
+        age = now - st.synced
+        cached = (st.status_line() if st.synced and st.updated and age <= max_age
+                  and now >= st.down_until else None)
+    if cached:
+        STATUS_ANSWERS_TOTAL.inc(device=trace.device, source="cache")
+        return {"ok": True, "detail": cached, "cached": True, "age_ms": round(age * 1000.0, 1)}
+
+    res = coalesce((trace.device, "status"), lambda: query_status(device_port, trace))
+    STATUS_ANSWERS_TOTAL.inc(device=trace.device,
+                             source="coalesced" if res.get("coalesced") else "device")
+    return res
+
+
+def query_status(device_port: str, trace: RequestTrace):
+    t = connect_device(device_port, trace)
     try:
-        t.flush_input()
         line = "STATUS"
         print(">>", line)
-        t.write_line(line)
+        with trace.stage("send"):
+            t.write_line(line)
 
-        resp = read_until_prefix(t, ["STATUS", "ERROR", "RESULT"], timeout=2.0)
+        with trace.stage("wait_status"):
+            resp = read_until_prefix(t, ["STATUS", "ERROR", "RESULT"], timeout=2.0)
         if resp is None:
+            trace.timeout("wait_status")
             return {"ok": False, "error": "timeout in attesa di STATUS"}
+        if resp.startswith("STATUS_OK"):
+            note_status(trace.device, resp)
+        return {"ok": True, "detail": resp}
+    finally:
+        t.close()
+
+
+# Invocazioni schedulate sul device (SCHEDULE/UNSCHEDULE/FETCH)
+# Il device esegue la funzione sui propri timer: nessun round-trip host -> gateway -> UART per tick.
+# I risultati restano nel ring dell'agent (letti con FETCH) oppure, con mode=stream, vengono
+# scritti subito sul canale come righe SRESULT (utile con un monitor collegato alla seriale).
+
+def parse_kv_line(line: str) -> dict:
+    out = {}
+    for tok in line.split()[1:]:
+        key, sep, val = tok.partition("=")
+        if sep:
+            out[key] = int(val) if val.isdigit() else val
+    return out
+
+
+def gw_schedule(device_port: str, module_id: str, func_name: str, func_args: str,
+                period_ms: int, delay_ms, max_runs: int, mode: str,
+                trace: RequestTrace):
+    parts = [f"SCHEDULE module_id={module_id}", f"func={func_name}"]
+    if func_args:
+        parts.append(f"args=\"{func_args}\"")
+    if period_ms:
+        parts.append(f"period_ms={period_ms}")
+    if delay_ms is not None:
+        parts.append(f"delay_ms={delay_ms}")
+    if max_runs:
+        parts.append(f"max_runs={max_runs}")
+    parts.append(f"mode={mode}")
+    line = " ".join(parts)
+
+    t = connect_device(device_port, trace)
+    try:
+        err = check_call(t, trace, module_id, func_name, func_args)
+        if err:
+            return err
+        print(">>", line)
+        with trace.stage("send"):
+            t.write_line(line)
+
+        with trace.stage("wait_schedule_ok"):
+            resp = read_until_prefix(t, ["SCHEDULE_OK", "SCHEDULE_ERR", "ERROR"], timeout=3.0)
+        if resp is None:
+            trace.timeout("wait_schedule_ok")
+            return {"ok": False, "error": "timeout in attesa di SCHEDULE_OK/SCHEDULE_ERR"}
+        if not resp.startswith("SCHEDULE_OK"):
+            return {"ok": False, "error": resp}
+        return {"ok": True, "detail": resp, "sched_id": parse_kv_line(resp).get("sched_id")}
+    finally:
+        t.close()
+
+
+def gw_unschedule(device_port: str, sched_id: int, trace: RequestTrace):
+    t = connect_device(device_port, trace)
+    try:
+        line = f"UNSCHEDULE sched_id={sched_id}"
+        print(">>", line)
+        with trace.stage("send"):
+            t.write_line(line)
+
+        with trace.stage("wait_unschedule_ok"):
+            resp = read_until_prefix(t, ["UNSCHEDULE_OK", "UNSCHEDULE_ERR", "ERROR"], timeout=3.0)
+        if resp is None:
+            trace.timeout("wait_unschedule_ok")
+            return {"ok": False, "error": "timeout in attesa di UNSCHEDULE_OK/UNSCHEDULE_ERR"}
+        if not resp.startswith("UNSCHEDULE_OK"):
+            return {"ok": False, "error": resp}
         return {"ok": True, "detail": resp}
     finally:
         t.close()
 
 
+def gw_fetch(device_port: str, max_results: int, trace: RequestTrace):
+    t = connect_device(device_port, trace)
+    try:
+        line = f"FETCH max={max_results}" if max_results else "FETCH"
+        print(">>", line)
+        with trace.stage("send"):
+            t.write_line(line)
+
+        # righe SRESULT fino a FETCH_OK (a 115200 baud ~10 ms per riga)
+        results = []
+        with trace.stage("wait_fetch_ok"):
+            while True:
+                resp = read_until_prefix(t, ["SRESULT", "FETCH_OK", "ERROR"], timeout=3.0)
+                if resp is None or not resp.startswith("SRESULT"):
+                    break
+                kv = parse_kv_line(resp)
+                results.append({**kv, **parse_call_results(kv)})
+        if resp is None:
+            trace.timeout("wait_fetch_ok")
+            return {"ok": False, "error": "timeout in attesa di FETCH_OK", "results": results}
+        if not resp.startswith("FETCH_OK"):
+            return {"ok": False, "error": resp, "results": results}
+        summary = parse_kv_line(resp)
+        return {"ok": True, "results": results,
+                "pending": summary.get("pending", 0), "dropped": summary.get("dropped", 0)}
+    finally:
+        t.close()
+
+
+# Promozione automatica ad AOT
+#
+# Per ogni device si ricorda il modulo wasm deployato con auto_promote e si contano,
+# per funzione, le chiamate (START_OK) e i cicli riportati nei RESULT (cycles=).
+# Superata una soglia parte un thread che compila l'AOT con wamrc e fa LOAD con lo stesso
+# module_id: l'agent istanzia la nuova versione accanto a quella in uso e la attiva subito,
+# il job in corso finisce sulla vecchia. Il client non deve rifare il deploy.
+
+class Promotion:
+    def __init__(self, device: str, port: str, module_id: str, wasm: bytes, aot_target,
+                 profile: str):
+        self.device = device
+        self.port = port
+        self.module_id = module_id
+        self.wasm = wasm              # copia del modulo, per compilare l'AOT più tardi
+        self.aot_target = aot_target
+        self.profile = profile        # profilo di build anche per l'AOT promosso
+        self.calls = {}               # func -> chiamate
+        self.cycles = {}              # func -> cicli cumulati
+        self.state = "interp"         # interp -> compiling -> aot | failed
+
+    def hot_function(self):
+        for func, n in self.calls.items():
+            if PROMOTE_AFTER_CALLS and n >= PROMOTE_AFTER_CALLS:
+                return func
+            if PROMOTE_AFTER_CYCLES and self.cycles.get(func, 0) >= PROMOTE_AFTER_CYCLES:
+                return func
+        return None
+
+
+_promotions = {}   # device_port -> Promotion
+_promotions_guard = threading.Lock()
+
+
+def register_promotion(device: str, device_port: str, module_id: str,
+                       wasm: bytes, aot_target, profile: str = BUILD_PROFILE_DEFAULT):
+    with _promotions_guard:
+        _promotions[device_port] = Promotion(device, device_port, module_id, wasm, aot_target,
+                                             profile)
+
+
+def forget_promotion(device_port: str):
+    with _promotions_guard:
+        _promotions.pop(device_port, None)
+
+
+# Cicli di CPU di un RESULT: cycles finché il contatore a 32 bit non può aver fatto il giro,
+# altrimenti exec_us convertiti alla frequenza del device
+def result_cycles(kv: dict) -> int:
+    try:
+        cycles, exec_us = int(kv.get("cycles") or 0), int(kv.get("exec_us") or 0)
+    except ValueError:
+        return 0
+    return exec_us * PROMOTE_CPU_MHZ if exec_us >= CYCLES_WRAP_US else cycles
+
+
+# RESULT di un job eseguito (dal thread lettore del link, per tutti i job del device)
+def note_call(device_port: str, module_id: str, func_name: str, kv: dict):
+    with _promotions_guard:
+        p = _promotions.get(device_port)
+        if p is None or p.module_id != module_id or p.state != "interp":
+            return
+        p.calls[func_name] = p.calls.get(func_name, 0) + 1
+        p.cycles[func_name] = p.cycles.get(func_name, 0) + result_cycles(kv)
+        hot = p.hot_function()
+        if hot is None:
+            return
+        p.state = "compiling"
+    print(f"[promote] {p.device}/{module_id}: funzione calda {hot} "
+          f"(calls={p.calls[hot]} cycles={p.cycles.get(hot, 0)}), compilo AOT")
+    threading.Thread(target=promote_module, args=(p,), daemon=True).start()
+
+
+def promote_module(p: Promotion):
+    trace = RequestTrace(p.device, "promote", p.module_id)
+    res = run_promotion(p, trace)
+    outcome = res.pop("outcome")
+    with _promotions_guard:
+        if _promotions.get(p.port) is p:
+            p.state = "aot" if outcome == "ok" else "failed"
+    PROMOTIONS_TOTAL.inc(device=p.device, module=p.module_id, outcome=outcome)
+    record_request(trace, res)
+    print(f"[promote] {p.device}/{p.module_id}: {outcome}", res.get("detail") or res.get("error", ""))
+
+
+def run_promotion(p: Promotion, trace: RequestTrace):
+    with tempfile.TemporaryDirectory() as tmpdir:
+        wasm_path = os.path.join(tmpdir, f"{p.module_id}.wasm")
+        aot_path = os.path.join(tmpdir, f"{p.module_id}.aot")
+        with open(wasm_path, "wb") as f:
+            f.write(p.wasm)
+        with trace.stage("compile_aot"):
+            res_aot = compile_to_aot(wasm_path, aot_path, p.aot_target, p.profile)
+        if not res_aot.get("ok"):
+            return {"ok": False, "outcome": "compile_error", **res_aot}
+        with open(aot_path, "rb") as f:
+            aot = f.read()
+
+    t = connect_device(p.port, trace)
+    try:
+        with _promotions_guard:
+            if _promotions.get(p.port) is not p:
+                return {"ok": False, "outcome": "superseded",
+                        "error": "modulo sostituito da un nuovo deploy"}
+        res = load_module(t, p.module_id, aot, trace)
+    finally:
+        t.close()
+    if res.get("ok"):
+        note_loaded(p.device, p.module_id, res["detail"])
+    res["outcome"] = "ok" if res.get("ok") else "load_error"
+    return res
+
+
 # build_and_deploy 
-# Modalità: wasm oppure aot
+# Modalità: wasm, aot oppure auto
 #   wasm: compila C -> wasm e deploya il wasm
 #   aot:  compila C -> wasm, poi wasm -> aot, deploya l'aot
+#   auto: deploya il wasm e lo promuove ad AOT quando diventa caldo (vedi sopra)
 
 def gw_build_and_deploy(device_port: str, module_id: str,
-                        source_path: str, mode: str):
-   
+                        source_path: str, mode: str, trace: RequestTrace,
+                        aot_target=None, profile: str = BUILD_PROFILE_DEFAULT):
+
     source_path = os.path.abspath(source_path)
     if not os.path.isfile(source_path):
         return {"ok": False, "error": f"sorgente C non trovato: {source_path}"}
+    if profile not in BUILD_PROFILES:
+        return {"ok": False,
+                "error": f"profilo sconosciuto: {profile} (validi: {', '.join(BUILD_PROFILES)})"}
 
     with tempfile.TemporaryDirectory() as tmpdir:
         tmpdir_p = Path(tmpdir)
         wasm_path = str(tmpdir_p / f"{module_id}.wasm")
-        res_wasm = compile_to_wasm(source_path, wasm_path)
+        with trace.stage("compile_wasm"):
+            res_wasm = compile_to_wasm(source_path, wasm_path, profile)
         if not res_wasm.get("ok"):
             return {"ok": False, "step": "compile_wasm", **res_wasm}
+        with open(wasm_path, "rb") as f:
+            remember_image(module_id, f.read(), aot_target, mode == "auto", profile)
 
         deploy_path = wasm_path
-        extra = {"wasm_path": wasm_path}
+        # dimensioni del codice per il confronto tra profili (bench.py --profiles)
+        extra = {"wasm_path": wasm_path, "profile": profile,
+                 "wasm_size": os.path.getsize(wasm_path)}
 
         if mode == "aot":
             aot_path = str(tmpdir_p / f"{module_id}.aot")
-            res_aot = compile_to_aot(wasm_path, aot_path)
+            with trace.stage("compile_aot"):
+                res_aot = compile_to_aot(wasm_path, aot_path, aot_target, profile)
             if not res_aot.get("ok"):
                 return {"ok": False, "step": "compile_aot", **res_aot}
             deploy_path = aot_path
             extra["aot_path"] = aot_path
+            extra["aot_size"] = os.path.getsize(aot_path)
 
-        res_dep = gw_deploy(device_port, module_id, deploy_path)
+        res_dep = gw_deploy(device_port, module_id, deploy_path, trace,
+                            auto_promote=(mode == "auto"), aot_target=aot_target,
+                            profile=profile)
         return {"step": "deploy", **extra, **res_dep}
 
 
+# Metriche per richiesta: outcome, durata totale, durata per stadio, timeout e retry
+
+def record_request(trace: RequestTrace, resp: dict):
+    if resp.get("ok"):
+        outcome = "ok"
+    elif trace.timeouts:
+        outcome = "timeout"
+    else:
+        outcome = "error"
+
+    REQUESTS_TOTAL.inc(device=trace.device, cmd=trace.cmd,
+                       module=trace.module, outcome=outcome)
+    if outcome == "ok" and trace.cmd in ("start", "stop", "status", "probe"):
+        note_latency(trace.device, trace.elapsed())   # latenza recente per il placement
+    REQUEST_DURATION.observe(trace.elapsed(), device=trace.device,
+                             cmd=trace.cmd, module=trace.module)
+    for stage, sec in trace.stages.items():
+        STAGE_DURATION.observe(sec, device=trace.device, cmd=trace.cmd, stage=stage)
+    for stage in trace.timeouts:
+        TIMEOUTS_TOTAL.inc(device=trace.device, cmd=trace.cmd, stage=stage)
+    if trace.retries:
+        RETRIES_TOTAL.inc(trace.retries, device=trace.device, cmd=trace.cmd)
+
+
+# Placement con device=auto
+# start va sul device meno carico che ha già il modulo residente (se è pieno, BUSY/REJECTED,
+# si prova il successivo); se nessun device lo ha, il gateway lo deploya sul device più libero
+# usando l'ultima immagine ricevuta con quel module_id. deploy/build_and_deploy scelgono il
+# device più libero, stop e schedule vanno dove il modulo è residente, status riporta la vista
+# del gateway su tutti i device.
+
+_images = {}   # module_id -> {"wasm": bytes | None, "aot": {target: bytes}, "auto_promote": bool, "profile": str}
+_images_guard = threading.Lock()
+
+
+def remember_image(module_id: str, data: bytes, aot_target, auto_promote: bool,
+                   profile: str = BUILD_PROFILE_DEFAULT):
+    with _images_guard:
+        img = _images.setdefault(module_id, {"wasm": None, "aot": {}, "auto_promote": False,
+                                             "profile": BUILD_PROFILE_DEFAULT})
+        if data.startswith(b"\x00aot"):
+            # un AOT vale solo per il target per cui è stato compilato
+            img["aot"][tuple(aot_target or AOT_TARGET_DEFAULT)] = data
+        else:
+            img["wasm"] = data
+            img["aot"].clear()    # AOT di una versione precedente del modulo
+        img["auto_promote"] = auto_promote
+        img["profile"] = profile
+
+
+# Immagine deployabile su 'device': AOT per il suo target se c'è, altrimenti il bytecode
+def image_for(module_id: str, device: str):
+    target = tuple(AOT_TARGETS.get(device, AOT_TARGET_DEFAULT))
+    with _images_guard:
+        img = _images.get(module_id)
+        if img is None:
+            return None, False, BUILD_PROFILE_DEFAULT
+        return img["aot"].get(target) or img["wasm"], img["auto_promote"], img["profile"]
+
+
+# Rilegge con STATUS (in parallelo) i device con stato vecchio e link libero; full=True
+# (cmd=status) guarda l'età dell'ultimo STATUS_OK invece che dell'ultimo aggiornamento
+def refresh_states(max_age: float = STATE_MAX_AGE_S, full: bool = False):
+    now = time.time()
+    stale = []
+    for name in DEVICE_ENDPOINTS:
+        st = device_state(name)
+        with _states_guard:
+            if now < st.down_until or st.link_pending:
+                continue
+            if now - (st.synced if full else st.updated) > max_age:
+                stale.append(name)
+
+    def probe(name):
+        trace = RequestTrace(name, "probe", "")
+        try:
+            res = gw_status(DEVICE_ENDPOINTS[name], trace, max_age=0.0)
+        except Exception as e:
+            res = {"ok": False, "error": f"errore verso il device: {e}"}
+        if not res.get("ok") or not str(res.get("detail", "")).startswith("STATUS_OK"):
+            note_down(name)
+        record_request(trace, res)
+
+    threads = [threading.Thread(target=probe, args=(name,), daemon=True) for name in stale]
+    for th in threads:
+        th.start()
+    for th in threads:
+        th.join(timeout=10.0)
+
+
+def live_states():
+    now = time.time()
+    states = [device_state(name) for name in DEVICE_ENDPOINTS]
+    with _states_guard:
+        return [st for st in states if now >= st.down_until and st.seen]
+
+
+# Device con il modulo residente, dal meno carico
+def resident_devices(module_id: str):
+    states = [st for st in live_states() if st.module_id == module_id]
+    with _states_guard:
+        states.sort(key=DeviceState.load)
+    return [st.name for st in states]
+
+
+def busy_device(device: str) -> bool:
+    st = device_state(device)
+    with _states_guard:
+        return st.load()[0] > 0
+
+
+# Device su cui deployare: prima quelli dove il LOAD non toglie un modulo in uso, poi il carico
+def deploy_candidates(module_id: str):
+    states = live_states()
+    with _states_guard:
+        states.sort(key=lambda st: (st.module_id not in (None, module_id) and st.runner_busy,
+                                    st.module_id not in (None, module_id),
+                                    st.load()))
+    return [st.name for st in states]
+
+
+def dispatch_auto(req: dict):
+    cmd = str(req.get("cmd"))
+    module_id = req.get("module_id", "")
+
+    if cmd == "status":
+        max_age_ms = req.get("max_age_ms")
+        refresh_states(float(max_age_ms) / 1000.0 if max_age_ms is not None else STATUS_MAX_AGE_S,
+                       full=True)
+        states = [device_state(name) for name in DEVICE_ENDPOINTS]
+        with _states_guard:
+            devices = {st.name: st.snapshot() for st in states}
+        return {"ok": True, "devices": devices}, RequestTrace("auto", cmd, "")
+
+    if cmd == "job":
+        # job_id è per device: il job avviato più di recente con quel job_id
+        matches = [j for j in (get_job(name, int(req["job_id"])) for name in DEVICE_ENDPOINTS) if j]
+        if not matches:
+            return ({"ok": False, "error": f"job {req['job_id']} sconosciuto (o uscito dallo store)"},
+                    RequestTrace("auto", cmd, ""))
+        job = max(matches, key=lambda j: j.get("started_at") or 0.0)
+        return {"ok": True, "job": job}, RequestTrace(job["device"], cmd, "")
+
+    if cmd not in ("start", "stop", "schedule", "deploy", "build_and_deploy"):
+        return ({"ok": False, "error": f"device=auto non supportato per {cmd}"},
+                RequestTrace("auto", cmd, module_id))
+
+    refresh_states()
+
+    if cmd in ("deploy", "build_and_deploy"):
+        candidates = deploy_candidates(module_id)
+        if not candidates:
+            return {"ok": False, "error": "nessun device raggiungibile"}, RequestTrace("auto", cmd, module_id)
+        device = candidates[0]
+        trace = RequestTrace(device, cmd, module_id)
+        resp = dispatch_request(req, DEVICE_ENDPOINTS[device], trace)
+        PLACEMENTS_TOTAL.inc(device=device, cmd=cmd, placement="least_loaded")
+        return {"device": device, **resp}, trace
+
+    resident = resident_devices(module_id)
+
+    if cmd == "stop" and req.get("job_id"):
+        # job_id è per device (ogni agent ha il suo contatore): STOP solo al device che ha
+        # il job in corso o in coda secondo lo store, mai a tutti quelli con il modulo
+        job_id = int(req["job_id"])
+        jobs = [j for j in (get_job(name, job_id) for name in DEVICE_ENDPOINTS) if j]
+        owners = [j["device"] for j in jobs
+                  if j["state"] == "pending" and j.get("module_id") in (None, module_id)]
+        if len(owners) != 1:
+            why = "non trovato" if not owners else f"ambiguo ({', '.join(owners)})"
+            return ({"ok": False,
+                     "error": f"job {job_id} del modulo {module_id} {why}: "
+                              "con device=auto serve un job avviato tramite il gateway, "
+                              "altrimenti indicare il device"},
+                    RequestTrace("auto", cmd, module_id))
+        device = owners[0]
+        trace = RequestTrace(device, cmd, module_id)
+        return {"device": device, **dispatch_request(req, DEVICE_ENDPOINTS[device], trace)}, trace
+
+    if cmd == "stop":
+        # il modulo può girare su più device: STOP su ciascuno, una risposta per device
+        if not resident:
+            return ({"ok": False, "error": f"modulo {module_id} non residente su nessun device"},
+                    RequestTrace("auto", cmd, module_id))
+        results = {}
+        for device in resident:
+            trace = RequestTrace(device, cmd, module_id)
+            results[device] = dispatch_request(req, DEVICE_ENDPOINTS[device], trace)
+            if device != resident[-1]:
+                record_request(trace, results[device])
+        ok = any(r.get("ok") for r in results.values())
+        return {"ok": ok, "devices": results}, trace
+
+    placement = "resident"
+    if cmd == "start" and resident and busy_device(resident[0]):
+        # tutti i device con il modulo hanno lavoro davanti: meglio un device vuoto e fermo
+        spare = [d for d in deploy_candidates(module_id)
+                 if device_state(d).module_id is None and not busy_device(d)]
+        if spare and image_for(module_id, spare[0])[0]:
+            resident = []
+    if not resident:
+        if cmd == "schedule":
+            return ({"ok": False, "error": f"modulo {module_id} non residente su nessun device"},
+                    RequestTrace("auto", cmd, module_id))
+        # deploy su richiesta sul device più libero
+        candidates = [d for d in deploy_candidates(module_id) if image_for(module_id, d)[0]]
+        if not candidates:
+            return ({"ok": False,
+                     "error": f"modulo {module_id} mai deployato tramite il gateway: serve un deploy"},
+                    RequestTrace("auto", cmd, module_id))
+        device = candidates[0]
+        data, auto_promote, profile = image_for(module_id, device)
+        dtrace = RequestTrace(device, "deploy", module_id)
+        dres = deploy_image(DEVICE_ENDPOINTS[device], module_id, data, dtrace, auto_promote,
+                            AOT_TARGETS.get(device, AOT_TARGET_DEFAULT), profile)
+        record_request(dtrace, dres)
+        PLACEMENTS_TOTAL.inc(device=device, cmd="deploy", placement="on_demand")
+        if not dres.get("ok"):
+            return {"device": device, "step": "deploy", **dres}, RequestTrace(device, cmd, module_id)
+        resident = [device]
+        placement = "deployed"
+
+    # coda piena o deadline non rispettabile su un device: si prova il successivo
+    for device in resident:
+        trace = RequestTrace(device, cmd, module_id)
+        resp = dispatch_request(req, DEVICE_ENDPOINTS[device], trace)
+        err = str(resp.get("error", ""))
+        if resp.get("ok") or device == resident[-1] or not (
+                "status=BUSY" in err or "status=REJECTED" in err):
+            break
+        record_request(trace, resp)
+    PLACEMENTS_TOTAL.inc(device=device, cmd=cmd, placement=placement)
+    return {"device": device, "placement": placement, **resp}, trace
+
+
 # Server TCP del gateway
 
+def dispatch_request(req: dict, port: str, trace: RequestTrace):
+    cmd = req.get("cmd")
+
+    if cmd == "deploy":
+        return gw_deploy(
+            port,
+            req["module_id"],
+            req["wasm_path"],
+            trace,
+            bool(req.get("auto_promote", False)),
+            AOT_TARGETS.get(trace.device, AOT_TARGET_DEFAULT),
+            req.get("profile", BUILD_PROFILE_DEFAULT),
+        )
+    elif cmd == "start":
+        return gw_start(
+            port,
+            req["module_id"],
+            req["func_name"],
+            req.get("func_args", ""),
+            bool(req.get("wait_result", False)),
+            float(req.get("result_timeout", 10.0)),
+            trace,
+            req.get("prio"),
+            req.get("deadline_ms"),
+        )
+    elif cmd == "stop":
+        return gw_stop(
+            port,
+            req["module_id"],
+            float(req.get("result_timeout", 10.0)),
+            trace,
+            req.get("job_id"),
+        )
+    elif cmd == "status":
+        max_age_ms = req.get("max_age_ms")
+        return gw_status(port, trace, float(max_age_ms) / 1000.0 if max_age_ms is not None else None)
+    elif cmd == "schedule":
+        delay_ms = req.get("delay_ms")
+        return gw_schedule(
+            port,
+            req["module_id"],
+            req["func_name"],
+            req.get("func_args", ""),
+            int(req.get("period_ms", 0)),
+            int(delay_ms) if delay_ms is not None else None,
+            int(req.get("max_runs", 0)),
+            req.get("mode", "batch"),
+            trace,
+        )
+    elif cmd == "unschedule":
+        return gw_unschedule(port, int(req["sched_id"]), trace)
+    elif cmd == "fetch":
+        return gw_fetch(port, int(req.get("max", 0)), trace)
+    elif cmd == "job":
+        # risultato dallo store del gateway: il device non viene interrogato
+        job = get_job(trace.device, int(req["job_id"]))
+        if job is None:
+            return {"ok": False, "error": f"job {req['job_id']} sconosciuto (o uscito dallo store)"}
+        return {"ok": True, "job": job}
+    elif cmd == "build_and_deploy":
+        mode = req.get("mode", "wasm")
+        return gw_build_and_deploy(
+            port,
+            req["module_id"],
+            req["source_path"],
+            mode,
+            trace,
+            AOT_TARGETS.get(trace.device, AOT_TARGET_DEFAULT),
+            req.get("profile", BUILD_PROFILE_DEFAULT),
+        )
+    else:
+        return {"ok": False, "error": f"comando sconosciuto: {cmd}"}
+
+
+def execute_request(req: dict) -> dict:
+    device = req.get("device")
+    if device != "auto" and device not in DEVICE_ENDPOINTS:
+        return {"ok": False, "error": f"device sconosciuto: {device}"}
+
+    trace = RequestTrace(device, str(req.get("cmd")), req.get("module_id", ""))
+
+    try:
+        if device == "auto":
+            resp, trace = dispatch_auto(req)
+        else:
+            resp = dispatch_request(req, DEVICE_ENDPOINTS[device], trace)
+    except KeyError as e:
+        resp = {"ok": False, "error": f"parametro mancante: {e}"}
+    except Exception as e:
+        # es. porta seriale non apribile dopo i retry, connessione rifiutata dal bridge
+        resp = {"ok": False, "error": f"errore verso il device: {e}"}
+
+    resp["timings_ms"] = trace.timings_ms()
+    record_request(trace, resp)
+    return resp
+
+
 def handle_client(conn, addr):
     try:
         buf = bytearray()
@@ -384,61 +1868,106 @@ def handle_client(conn, addr):
         if not buf:
             return
 
+        line, _, rest = bytes(buf).partition(b"\n")
         try:
-            req = json.loads(buf.decode("utf-8").strip())
+            req = json.loads(line.decode("utf-8").strip())
         except Exception as e:
             resp = {"ok": False, "error": f"json non valido: {e}"}
             conn.sendall((json.dumps(resp) + "\n").encode("utf-8"))
             return
 
-        device = req.get("device")
-        if device not in DEVICE_ENDPOINTS:
-            resp = {"ok": False, "error": f"device sconosciuto: {device}"}
-            conn.sendall((json.dumps(resp) + "\n").encode("utf-8"))
+        if req.get("cmd") == "subscribe":
+            serve_subscription(conn, req, bytearray(rest))
             return
 
-        port = DEVICE_ENDPOINTS[device]
-        cmd = req.get("cmd")
-
-        if cmd == "deploy":
-            resp = gw_deploy(
-                port,
-                req["module_id"],
-                req["wasm_path"],
-            )
-        elif cmd == "start":
-            resp = gw_start(
-                port,
-                req["module_id"],
-                req["func_name"],
-                req.get("func_args", ""),
-                bool(req.get("wait_result", False)),
-                float(req.get("result_timeout", 10.0)),
-            )
-        elif cmd == "stop":
-            resp = gw_stop(
-                port,
-                req["module_id"],
-                float(req.get("result_timeout", 10.0)),
-            )
-        elif cmd == "status":
-            resp = gw_status(port)
-        elif cmd == "build_and_deploy":
-            mode = req.get("mode", "wasm")
-            resp = gw_build_and_deploy(
-                port,
-                req["module_id"],
-                req["source_path"],
-                mode,
-            )
-        else:
-            resp = {"ok": False, "error": f"comando sconosciuto: {cmd}"}
-
+        resp = execute_request(req)
         conn.sendall((json.dumps(resp) + "\n").encode("utf-8"))
     finally:
         conn.close()
 
 
+# Connessione subscribe: il gateway invia gli eventi come righe JSON (NDJSON) finché il
+# client non chiude. Sulla stessa connessione il client può mandare altri comandi, una riga
+# JSON ciascuno, senza attendere: ognuno gira in un thread e la risposta arriva come evento
+# {"event": "reply", "id": <id della richiesta>, ...}. Con start senza wait_result il
+# risultato arriva poi come evento result/stopped.
+#
+#   {"cmd": "subscribe", "device": "nucleo" | ["nucleo", "disco"] | "*", "events": ["result", ...]}
+
+def serve_subscription(conn, req: dict, buf: bytearray):
+    devices = req.get("device")
+    if devices in (None, "*", "auto"):
+        devices = []
+    elif isinstance(devices, str):
+        devices = [devices]
+    unknown = [d for d in devices if d not in DEVICE_ENDPOINTS]
+    if unknown:
+        conn.sendall((json.dumps({"ok": False, "error": f"device sconosciuto: {unknown[0]}"}) + "\n").encode("utf-8"))
+        return
+
+    sub = Subscriber(devices, req.get("events"))
+    with _subscribers_guard:
+        _subscribers.append(sub)
+    SUBSCRIBERS.inc()
+
+    # apre subito i link, così si ricevono anche gli eventi dei device non ancora usati
+    for name in devices or DEVICE_ENDPOINTS:
+        try:
+            device_link(name, DEVICE_ENDPOINTS[name]).ensure_open()
+        except (OSError, RuntimeError, ValueError) as e:
+            print(f"[link] {name}: non raggiungibile ({e})")
+
+    def run_command(cmd_req: dict):
+        resp = execute_request(cmd_req)
+        sub.push({"event": "reply", "id": cmd_req.get("id"), "cmd": cmd_req.get("cmd"), **resp})
+
+    def read_commands():
+        nonlocal buf
+        try:
+            while True:
+                while b"\n" in buf:
+                    line, _, rest = bytes(buf).partition(b"\n")
+                    buf = bytearray(rest)
+                    if not line.strip():
+                        continue
+                    try:
+                        cmd_req = json.loads(line.decode("utf-8"))
+                    except Exception as e:
+                        sub.push({"event": "reply", "ok": False, "error": f"json non valido: {e}"})
+                        continue
+                    if cmd_req.get("cmd") == "subscribe":
+                        sub.push({"event": "reply", "id": cmd_req.get("id"), "ok": False,
+                                  "error": "subscribe già attivo su questa connessione"})
+                        continue
+                    threading.Thread(target=run_command, args=(cmd_req,), daemon=True).start()
+                chunk = conn.recv(4096)
+                if not chunk:
+                    break
+                buf += chunk
+        except OSError:
+            pass
+        sub.close()
+
+    threading.Thread(target=read_commands, daemon=True).start()
+    try:
+        conn.sendall((json.dumps({"event": "subscribed", "ok": True,
+                                  "devices": devices or sorted(DEVICE_ENDPOINTS),
+                                  "events": sorted(sub.events) if sub.events else "*"}) + "\n").encode("utf-8"))
+        while True:
+            ev = sub.pop(timeout=1.0)
+            if ev is None:
+                if sub.closed:
+                    break
+                continue
+            conn.sendall((json.dumps(ev) + "\n").encode("utf-8"))
+    except OSError:
+        pass
+    finally:
+        with _subscribers_guard:
+            _subscribers.remove(sub)
+        SUBSCRIBERS.dec()
+
+
 def run_gateway(listen_host: str, listen_port: int):
     with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
         s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)  # Imposta l’opzione SO_REUSEADDR: permette di riusare rapidamente la stessa porta dopo un riavvio del processo, senza aspettare che il kernel liberi lo stato precedente
@@ -453,12 +1982,37 @@ def run_gateway(listen_host: str, listen_port: int):
 
 
 def main():
+    global PROMOTE_AFTER_CALLS, PROMOTE_AFTER_CYCLES, STATUS_MAX_AGE_S
     parser = argparse.ArgumentParser(
         description="Gateway per orchestrazione moduli Wasm/AOT su device STM32/Zephyr"
     )
     parser.add_argument("--host", default="0.0.0.0", help="Host di ascolto")
     parser.add_argument("--port", type=int, default=9000, help="Porta di ascolto")
+    parser.add_argument("--metrics-host", default="127.0.0.1",
+                        help="Host di ascolto dell'endpoint /metrics")
+    parser.add_argument("--metrics-port", type=int, default=9100,
+                        help="Porta dell'endpoint /metrics Prometheus (0 = disabilitato)")
+    parser.add_argument("--device-endpoint", action="append", default=[],
+                        metavar="NAME=PORT",
+                        help="Aggiunge/sovrascrive un device (es. fake=tcp:localhost:3460)")
+    parser.add_argument("--promote-after-calls", type=int, default=PROMOTE_AFTER_CALLS,
+                        help="Chiamate di una funzione dopo cui il modulo wasm passa ad AOT (0 = off)")
+    parser.add_argument("--promote-after-cycles", type=int, default=PROMOTE_AFTER_CYCLES,
+                        help="Cicli cumulati di una funzione dopo cui il modulo passa ad AOT (0 = off)")
+    parser.add_argument("--status-max-age", type=float, default=STATUS_MAX_AGE_S,
+                        help="Età massima (s) dello stato con cui il gateway risponde a status "
+                             "senza interrogare il device (0 = sempre STATUS sulla UART)")
     args = parser.parse_args()
+    PROMOTE_AFTER_CALLS = args.promote_after_calls
+    PROMOTE_AFTER_CYCLES = args.promote_after_cycles
+    STATUS_MAX_AGE_S = args.status_max_age
+    for item in args.device_endpoint:
+        name, sep, endpoint = item.partition("=")
+        if not sep or not name or not endpoint:
+            parser.error(f"--device-endpoint non valido: {item}")
+        DEVICE_ENDPOINTS[name] = endpoint
+    if args.metrics_port:
+        serve_metrics(METRICS, args.metrics_host, args.metrics_port)
     run_gateway(args.host, args.port)
 
 
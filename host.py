@@ -6,6 +6,10 @@ import sys
 import time
 
 
+# Profili di build del gateway (BUILD_PROFILES in gateway.py)
+BUILD_PROFILES = ("speed", "size", "trusted-fast")
+
+
 def send_request(gw_host: str, gw_port: int, payload: dict, timeout: float = 5.0):
     data = (json.dumps(payload) + "\n").encode("utf-8")     # trasforma il dizionario in stringa JSON, aggiunge un terminatore di riga e converte la stringa in bytes
     with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
@@ -52,6 +56,8 @@ def cmd_deploy(args):
         "device": args.device,
         "module_id": args.module_id,
         "wasm_path": args.wasm,
+        "auto_promote": bool(args.auto_promote),
+        "profile": args.profile,
     }
     t0 = time.perf_counter()
     resp = send_request(args.gw_host, args.gw_port, payload)
@@ -72,6 +78,10 @@ def cmd_start(args):
         "wait_result": bool(args.wait_result),
         "result_timeout": float(args.result_timeout),
     }
+    if args.prio:
+        payload["prio"] = args.prio
+    if args.deadline_ms:
+        payload["deadline_ms"] = args.deadline_ms
     timeout = args.result_timeout + 5.0 if args.wait_result else 10.0
     
     t0 = time.perf_counter()
@@ -90,6 +100,8 @@ def cmd_stop(args):
         "module_id": args.module_id,
         "result_timeout": float(args.result_timeout),
     }
+    if args.job_id:
+        payload["job_id"] = args.job_id
     timeout = args.result_timeout + 5.0
 
     t0 = time.perf_counter()
@@ -106,6 +118,8 @@ def cmd_status(args):
         "cmd": "status",
         "device": args.device,
     }
+    if args.max_age_ms is not None:
+        payload["max_age_ms"] = args.max_age_ms
     t0 = time.perf_counter()
     resp = send_request(args.gw_host, args.gw_port, payload)
     t1 = time.perf_counter()
@@ -115,6 +129,62 @@ def cmd_status(args):
     pretty_print_response(resp)
 
 
+def cmd_schedule(args):
+    payload = {
+        "cmd": "schedule",
+        "device": args.device,
+        "module_id": args.module_id,
+        "func_name": args.func_name,
+        "func_args": args.func_args or "",
+        "period_ms": args.period_ms,
+        "max_runs": args.max_runs,
+        "mode": args.mode,
+    }
+    if args.delay_ms is not None:
+        payload["delay_ms"] = args.delay_ms
+    t0 = time.perf_counter()
+    resp = send_request(args.gw_host, args.gw_port, payload)
+    t1 = time.perf_counter()
+    latency_ms = (t1 - t0) * 1000.0
+
+    print(f"e2e_latency_ms={latency_ms:.2f}")
+    pretty_print_response(resp)
+
+
+def cmd_unschedule(args):
+    payload = {
+        "cmd": "unschedule",
+        "device": args.device,
+        "sched_id": args.sched_id,
+    }
+    t0 = time.perf_counter()
+    resp = send_request(args.gw_host, args.gw_port, payload)
+    t1 = time.perf_counter()
+    latency_ms = (t1 - t0) * 1000.0
+
+    print(f"e2e_latency_ms={latency_ms:.2f}")
+    pretty_print_response(resp)
+
+
+def cmd_fetch(args):
+    payload = {
+        "cmd": "fetch",
+        "device": args.device,
+        "max": args.max,
+    }
+    while True:
+        t0 = time.perf_counter()
+        resp = send_request(args.gw_host, args.gw_port, payload, timeout=15.0)
+        t1 = time.perf_counter()
+        latency_ms = (t1 - t0) * 1000.0
+
+        print(f"e2e_latency_ms={latency_ms:.2f}")
+        pretty_print_response(resp)
+        if not args.follow or resp is None:
+            break
+        time.sleep(args.interval)   # lettura a batch: un round-trip ogni 'interval' invece che per tick
+
+
 def cmd_build_and_deploy(args):
     payload = {
         "cmd": "build_and_deploy",
@@ -122,6 +192,7 @@ def cmd_build_and_deploy(args):
         "module_id": args.module_id,
         "source_path": args.source,
         "mode": args.mode,
+        "profile": args.profile,
     }
     t0 = time.perf_counter()
     resp = send_request(args.gw_host, args.gw_port, payload, timeout=60.0)
@@ -132,6 +203,56 @@ def cmd_build_and_deploy(args):
     pretty_print_response(resp)
 
 
+def cmd_job(args):
+    payload = {
+        "cmd": "job",
+        "device": args.device,
+        "job_id": args.job_id,
+    }
+    t0 = time.perf_counter()
+    resp = send_request(args.gw_host, args.gw_port, payload)
+    t1 = time.perf_counter()
+    latency_ms = (t1 - t0) * 1000.0
+
+    print(f"e2e_latency_ms={latency_ms:.2f}")
+    pretty_print_response(resp)
+
+
+# Connessione subscribe persistente: stampa gli eventi del gateway (una riga JSON ciascuno)
+# finché non si interrompe con Ctrl-C; i comandi di --send partono subito, senza attesa,
+# e le risposte arrivano come eventi "reply"
+
+def cmd_watch(args):
+    payload = {
+        "cmd": "subscribe",
+        "device": "*" if args.device == "auto" else args.device,
+    }
+    if args.events:
+        payload["events"] = args.events.split(",")
+    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
+        s.connect((args.gw_host, args.gw_port))
+        s.sendall((json.dumps(payload) + "\n").encode("utf-8"))
+        for i, text in enumerate(args.send or []):
+            req = json.loads(text)
+            req.setdefault("device", args.device)
+            req.setdefault("id", i + 1)
+            s.sendall((json.dumps(req) + "\n").encode("utf-8"))
+
+        buf = bytearray()
+        try:
+            while True:
+                chunk = s.recv(4096)
+                if not chunk:
+                    break
+                buf += chunk
+                while b"\n" in buf:
+                    line, _, rest = bytes(buf).partition(b"\n")
+                    buf = bytearray(rest)
+                    print(line.decode("utf-8"), flush=True)
+        except KeyboardInterrupt:
+            pass
+
+
 
 # main
 
@@ -148,7 +269,7 @@ def main():
     parser.add_argument(
         "--device",
         required=True,
-        help="ID logico del device (es. nucleo, disco)",
+        help="ID logico del device (es. nucleo, disco, native), oppure auto per il placement del gateway",
     )
 
     subparsers = parser.add_subparsers(dest="command", required=True)
@@ -157,13 +278,24 @@ def main():
     p_deploy = subparsers.add_parser("deploy", help="Deploy di un modulo wasm/aot")
     p_deploy.add_argument("--module-id", required=True)
     p_deploy.add_argument("--wasm", required=True, help="File .wasm o .aot")
+    p_deploy.add_argument(
+        "--auto-promote",
+        action="store_true",
+        help="Il gateway ricompila il .wasm in AOT e lo ricarica quando diventa caldo",
+    )
+    p_deploy.add_argument(
+        "--profile",
+        choices=BUILD_PROFILES,
+        default="speed",
+        help="Profilo di build dell'AOT generato dalla promozione (default: speed)",
+    )
     p_deploy.set_defaults(func=cmd_deploy)
 
     # start
     p_start = subparsers.add_parser("start", help="Start di una funzione")
     p_start.add_argument("--module-id", required=True)
     p_start.add_argument("--func-name", required=True)
-    p_start.add_argument("--func-args", help='Argomenti "a=1,b=2"')
+    p_start.add_argument("--func-args", help='Argomenti "a=1,b=2.5", tipizzati secondo la firma (i32/i64/f32/f64)')
     p_start.add_argument(
         "--wait-result",
         action="store_true",
@@ -175,11 +307,22 @@ def main():
         default=10.0,
         help="Timeout attesa RESULT",
     )
+    p_start.add_argument(
+        "--prio",
+        choices=["high", "normal", "low"],
+        help="Classe di priorità del job sul device (default normal)",
+    )
+    p_start.add_argument(
+        "--deadline-ms",
+        type=int,
+        help="Tempo massimo per terminare: l'agent rifiuta il job se la coda non lo consente",
+    )
     p_start.set_defaults(func=cmd_start)
 
     # stop
     p_stop = subparsers.add_parser("stop", help="Stop di un job long-running")
     p_stop.add_argument("--module-id", required=True)
+    p_stop.add_argument("--job-id", type=int, help="Solo questo job (da START_OK job_id=...)")
     p_stop.add_argument(
         "--result-timeout",
         type=float,
@@ -190,8 +333,47 @@ def main():
 
     # status
     p_status = subparsers.add_parser("status", help="Stato del device")
+    p_status.add_argument("--max-age-ms", type=float,
+                          help="Età massima dello stato in cache sul gateway (0 = chiedi al device)")
     p_status.set_defaults(func=cmd_status)
 
+    # schedule
+    p_sched = subparsers.add_parser(
+        "schedule", help="Invocazione periodica o ritardata eseguita sul device"
+    )
+    p_sched.add_argument("--module-id", required=True)
+    p_sched.add_argument("--func-name", required=True)
+    p_sched.add_argument("--func-args", help='Argomenti "a=1,b=2.5", tipizzati secondo la firma (i32/i64/f32/f64)')
+    p_sched.add_argument("--period-ms", type=int, default=0,
+                         help="Periodo in ms (0 = one-shot dopo --delay-ms)")
+    p_sched.add_argument("--delay-ms", type=int, default=None,
+                         help="Ritardo del primo tick in ms (default: un periodo)")
+    p_sched.add_argument("--max-runs", type=int, default=0,
+                         help="Numero massimo di esecuzioni (0 = illimitato)")
+    p_sched.add_argument(
+        "--mode",
+        choices=["batch", "stream"],
+        default="batch",
+        help="batch: risultati nel ring del device (fetch); stream: righe SRESULT sul canale",
+    )
+    p_sched.set_defaults(func=cmd_schedule)
+
+    # unschedule
+    p_unsched = subparsers.add_parser("unschedule", help="Rimuove uno schedule")
+    p_unsched.add_argument("--sched-id", type=int, required=True)
+    p_unsched.set_defaults(func=cmd_unschedule)
+
+    # fetch
+    p_fetch = subparsers.add_parser(
+        "fetch", help="Legge a batch i risultati delle invocazioni schedulate"
+    )
+    p_fetch.add_argument("--max", type=int, default=0,
+                         help="Numero massimo di risultati (0 = tutti)")
+    p_fetch.add_argument("--follow", action="store_true",
+                         help="Ripete la lettura ogni --interval secondi")
+    p_fetch.add_argument("--interval", type=float, default=1.0)
+    p_fetch.set_defaults(func=cmd_fetch)
+
     # build-and-deploy
     p_build = subparsers.add_parser(
         "build-and-deploy",
@@ -205,12 +387,43 @@ def main():
     )
     p_build.add_argument(
         "--mode",
-        choices=["wasm", "aot"],
+        choices=["wasm", "aot", "auto"],
         default="wasm",
-        help="Tipo di binario da generare (default: wasm)",
+        help="Tipo di binario da generare (default: wasm; auto = wasm promosso ad AOT quando caldo)",
+    )
+    p_build.add_argument(
+        "--profile",
+        choices=BUILD_PROFILES,
+        default="speed",
+        help="Flag di clang e wamrc: speed (-O3), size (-Oz, AOT compatto), "
+             "trusted-fast (AOT senza bounds check, solo moduli fidati)",
     )
     p_build.set_defaults(func=cmd_build_and_deploy)
 
+    # job
+    p_job = subparsers.add_parser(
+        "job", help="Stato/risultato di un job dallo store del gateway"
+    )
+    p_job.add_argument("--job-id", type=int, required=True, help="job_id di START_OK")
+    p_job.set_defaults(func=cmd_job)
+
+    # watch
+    p_watch = subparsers.add_parser(
+        "watch", help="Stream degli eventi del gateway (job, risultati, reset del device)"
+    )
+    p_watch.add_argument(
+        "--events",
+        help="Solo questi eventi, separati da virgola (job_started,result,stopped,"
+             "sched_result,device_hello,device_down)",
+    )
+    p_watch.add_argument(
+        "--send",
+        action="append",
+        metavar="JSON",
+        help='Comando da inviare senza attesa, es. \'{"cmd":"start","module_id":"m","func_name":"add"}\'',
+    )
+    p_watch.set_defaults(func=cmd_watch)
+
     args = parser.parse_args()
     args.func(args)
 
@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+# Metriche del gateway: contatori/gauge/istogrammi in formato testo Prometheus
+# e tracciamento dei tempi per stadio di ogni richiesta.
+import threading
+import time
+from contextlib import contextmanager
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+
+# Bucket di default per le durate (secondi): coprono dal singolo comando
+# testuale su UART fino al build_and_deploy con compilazione AOT
+DEFAULT_BUCKETS = (0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5,
+                   1.0, 2.5, 5.0, 10.0, 30.0, 60.0)
+
+
+def _escape(value) -> str:
+    return (str(value).replace("\\", "\\\\")
+            .replace("\n", "\\n").replace("\"", "\\\""))
+
+
+def _format_labels(labelnames, values, extra=None) -> str:
+    pairs = [f'{n}="{_escape(v)}"' for n, v in zip(labelnames, values)]
+    if extra:
+        pairs += [f'{n}="{_escape(v)}"' for n, v in extra]
+    if not pairs:
+        return ""
+    return "{" + ",".join(pairs) + "}"
+
+
+class _Metric:
+    kind = ""
+
+    def __init__(self, name: str, help_text: str, labelnames=()):
+        self.name = name
+        self.help = help_text
+        self.labelnames = tuple(labelnames)
+        self.lock = threading.Lock()
+        self.series = {}   # tupla di valori delle label -> valore/stato
+
+    def _key(self, labels):
+        return tuple(str(labels.get(n, "")) for n in self.labelnames)
+
+    def render(self):
+        lines = [f"# HELP {self.name} {self.help}",
+                 f"# TYPE {self.name} {self.kind}"]
+        with self.lock:
+            for key in sorted(self.series):
+                lines += self._render_series(key, self.series[key])
+        return lines
+
+    def _render_series(self, key, value):
+        return [f"{self.name}{_format_labels(self.labelnames, key)} {value}"]
+
+
+class Counter(_Metric):
+    kind = "counter"
+
+    def inc(self, amount: float = 1, **labels):
+        key = self._key(labels)
+        with self.lock:
+            self.series[key] = self.series.get(key, 0) + amount
+
+
+class Gauge(_Metric):
+    kind = "gauge"
+
+    def inc(self, amount: float = 1, **labels):
+        key = self._key(labels)
+        with self.lock:
+            self.series[key] = self.series.get(key, 0) + amount
+
+    def dec(self, amount: float = 1, **labels):
+        self.inc(-amount, **labels)
+
+    def set(self, value: float, **labels):
+        key = self._key(labels)
+        with self.lock:
+            self.series[key] = value
+
+
+class Histogram(_Metric):
+    kind = "histogram"
+
+    def __init__(self, name, help_text, labelnames=(), buckets=DEFAULT_BUCKETS):
+        super().__init__(name, help_text, labelnames)
+        self.buckets = tuple(sorted(buckets))
+
+    def observe(self, value: float, **labels):
+        key = self._key(labels)
+        with self.lock:
+            state = self.series.get(key)
+            if state is None:
+                # [conteggi per bucket..., somma, conteggio totale]
+                state = [0] * len(self.buckets) + [0.0, 0]
+                self.series[key] = state
+            for i, bound in enumerate(self.buckets):
+                if value <= bound:
+                    state[i] += 1
+            state[-2] += value
+            state[-1] += 1
+
+    def _render_series(self, key, state):
+        lines = []
+        # i bucket sono già cumulativi: ogni osservazione incrementa tutti i bucket con bound >= valore
+        for i, bound in enumerate(self.buckets):
+            labels = _format_labels(self.labelnames, key, [("le", repr(bound))])
+            lines.append(f"{self.name}_bucket{labels} {state[i]}")
+        labels = _format_labels(self.labelnames, key, [("le", "+Inf")])
+        lines.append(f"{self.name}_bucket{labels} {state[-1]}")
+        plain = _format_labels(self.labelnames, key)
+        lines.append(f"{self.name}_sum{plain} {state[-2]:.6f}")
+        lines.append(f"{self.name}_count{plain} {state[-1]}")
+        return lines
+
+
+class Registry:
+    def __init__(self):
+        self.metrics = []
+
+    def counter(self, name, help_text, labelnames=()):
+        return self._add(Counter(name, help_text, labelnames))
+
+    def gauge(self, name, help_text, labelnames=()):
+        return self._add(Gauge(name, help_text, labelnames))
+
+    def histogram(self, name, help_text, labelnames=(), buckets=DEFAULT_BUCKETS):
+        return self._add(Histogram(name, help_text, labelnames, buckets))
+
+    def _add(self, metric):
+        self.metrics.append(metric)
+        return metric
+
+    def render(self) -> str:
+        lines = []
+        for m in self.metrics:
+            lines += m.render()
+        return "\n".join(lines) + "\n"
+
+
+# Tracciamento per richiesta
+
+class RequestTrace:
+    """Raccoglie la durata di ogni stadio di una richiesta (connect, send,
+    attesa LOAD_READY, ...), più timeout e retry, per device/comando/modulo."""
+
+    def __init__(self, device: str = "", cmd: str = "", module: str = ""):
+        self.device = device
+        self.cmd = cmd
+        self.module = module
+        self.t0 = time.perf_counter()
+        self.stages = {}     # nome stadio -> secondi (in ordine di esecuzione)
+        self.timeouts = []   # stadi terminati in timeout
+        self.retries = 0
+
+    @contextmanager
+    def stage(self, name: str):
+        t0 = time.perf_counter()
+        try:
+            yield
+        finally:
+            # uno stadio ripetuto (es. più RESULT intermedi) accumula la durata
+            self.stages[name] = self.stages.get(name, 0.0) + (time.perf_counter() - t0)
+
+    def timeout(self, stage: str):
+        self.timeouts.append(stage)
+
+    def elapsed(self) -> float:
+        return time.perf_counter() - self.t0
+
+    def timings_ms(self) -> dict:
+        out = {name: round(sec * 1000.0, 3) for name, sec in self.stages.items()}
+        out["total"] = round(self.elapsed() * 1000.0, 3)
+        return out
+
+
+# Endpoint HTTP /metrics
+
+def serve_metrics(registry: Registry, host: str, port: int):
+    """Avvia in un thread daemon un server HTTP che espone /metrics."""
+
+    class Handler(BaseHTTPRequestHandler):
+        def do_GET(self):
+            if self.path.split("?", 1)[0] != "/metrics":
+                self.send_error(404)
+                return
+            body = registry.render().encode("utf-8")
+            self.send_response(200)
+            self.send_header("Content-Type", "text/plain; version=0.0.4; charset=utf-8")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+        def log_message(self, fmt, *args):
+            pass   # niente log per ogni scrape
+
+    server = ThreadingHTTPServer((host, port), Handler)
+    server.daemon_threads = True
+    t = threading.Thread(target=server.serve_forever, daemon=True)
+    t.start()
+    print(f"Metrics endpoint on http://{host}:{port}/metrics")
+    return server